@@ -0,0 +1,67 @@
+// Copyright (c) 2011 Revelux Labs, LLC. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+#include "arena.h"
+
+#include <stdlib.h>
+
+__thread Arena::Chunk* Arena::free_chunks_ = NULL;
+
+// Everything handed out is aligned as strictly as malloc would align it.
+static const size_t kAlignment = 16;
+
+static size_t RoundUp(size_t size) {
+  return (size + kAlignment - 1) & ~(kAlignment - 1);
+}
+
+Arena::Arena() {
+  chunks_ = NULL;
+  next_ = limit_ = NULL;
+}
+
+Arena::~Arena() {
+  Reset();
+}
+
+void* Arena::Allocate(size_t size) {
+  size = RoundUp(size);
+  if (next_ == NULL || static_cast<size_t>(limit_ - next_) < size) {
+    NewChunk(size);
+  }
+  void* p = next_;
+  next_ += size;
+  return p;
+}
+
+void Arena::Reset() {
+  while (chunks_) {
+    Chunk* c = chunks_;
+    chunks_ = c->next;
+    if (c->size == kChunkSize) {
+      c->next = free_chunks_;
+      free_chunks_ = c;
+    } else {
+      free(c);
+    }
+  }
+  next_ = limit_ = NULL;
+}
+
+void Arena::NewChunk(size_t size) {
+  Chunk* c;
+  if (size <= kChunkSize && free_chunks_) {
+    c = free_chunks_;
+    free_chunks_ = c->next;
+  } else {
+    if (size < kChunkSize) {
+      size = kChunkSize;
+    }
+    c = static_cast<Chunk*>(malloc(RoundUp(sizeof(Chunk)) + size));
+    c->size = size;
+  }
+  c->next = chunks_;
+  chunks_ = c;
+  next_ = reinterpret_cast<char*>(c) + RoundUp(sizeof(Chunk));
+  limit_ = next_ + c->size;
+}
@@ -0,0 +1,55 @@
+// Copyright (c) 2011 Revelux Labs, LLC. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+#ifndef SRC_ARENA_H_
+#define SRC_ARENA_H_
+
+#include <stddef.h>
+
+// Arena -- memory that is freed all at once.
+//  A Context allocates its Nodes from its own Arena, and the Arena gives
+//  the memory back in one step when the Context is destroyed. Nothing in
+//  an Arena is freed on its own; destructors must be run by the owner.
+
+//  Chunks are recycled through a free list, so once a few frames have come
+//  and gone the nodes of a call do not reach malloc. The Context itself,
+//  the values of its arguments and scratch Texts still come from the heap.
+
+//  The free list belongs to the thread, so that engines run on several
+//  threads neither share it nor lock it. A chunk freed on another thread
+//  than the one that allocated it joins that thread's list.
+
+class Arena {
+ public:
+  Arena();
+  virtual ~Arena();
+
+  // Allocate
+  // Return size bytes aligned for any object
+  void*   Allocate(size_t size);
+
+  // Reset
+  // Give back everything allocated so far
+  void    Reset();
+
+ private:
+  struct Chunk {
+    Chunk*  next;
+    size_t  size;      // usable bytes after the header
+  };
+
+  static const size_t kChunkSize = 512;
+
+  // NewChunk
+  // Start a chunk that can hold at least size bytes
+  void    NewChunk(size_t size);
+
+  Chunk*  chunks_;     // chunks in use, newest first
+  char*   next_;       // next free byte in the newest chunk
+  char*   limit_;      // end of the newest chunk
+
+  static __thread Chunk* free_chunks_;  // recycled chunks of kChunkSize
+};
+
+#endif  // SRC_ARENA_H_
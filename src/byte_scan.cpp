@@ -0,0 +1,245 @@
+// Copyright (c) 2011 Revelux Labs, LLC. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+#include "byte_scan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    defined(__SSE2__)
+#define TILTON_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+#include "tilton.h"
+
+// A byte that reads as EOT is a char equal to EOT, as in Text::GetCharacter.
+static inline bool IsSyntax(char c) {
+  return c == '<' || c == '~' || c == EOT;
+}
+
+static int FindSyntaxPlain(const char* s, int i, int len) {
+  for (; i < len; i += 1) {
+    if (IsSyntax(s[i])) {
+      return i;
+    }
+  }
+  return len;
+}
+
+#ifdef TILTON_X86_SIMD
+
+static int FindSyntaxSSE2(const char* s, int len) {
+  const __m128i lt    = _mm_set1_epi8('<');
+  const __m128i tilde = _mm_set1_epi8('~');
+  const __m128i eot   = _mm_set1_epi8(static_cast<char>(EOT));
+  int i = 0;
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+    __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, lt),
+                                          _mm_cmpeq_epi8(v, tilde)),
+                             _mm_cmpeq_epi8(v, eot));
+    int mask = _mm_movemask_epi8(m);
+    if (mask) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  return FindSyntaxPlain(s, i, len);
+}
+
+__attribute__((target("avx2")))
+static int FindSyntaxAVX2(const char* s, int len) {
+  const __m256i lt    = _mm256_set1_epi8('<');
+  const __m256i tilde = _mm256_set1_epi8('~');
+  const __m256i eot   = _mm256_set1_epi8(static_cast<char>(EOT));
+  int i = 0;
+  for (; i + 32 <= len; i += 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+    __m256i m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, lt),
+                                                _mm256_cmpeq_epi8(v, tilde)),
+                                _mm256_cmpeq_epi8(v, eot));
+    unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(m));
+    if (mask) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  return FindSyntaxPlain(s, i, len);
+}
+
+static bool HaveAVX2() {
+  static int have = -1;
+  if (have < 0) {
+    __builtin_cpu_init();
+    have = __builtin_cpu_supports("avx2") ? 1 : 0;
+  }
+  return have == 1;
+}
+
+#endif  // TILTON_X86_SIMD
+
+int ByteScan::FindSyntax(const char* s, int len) {
+#ifdef TILTON_X86_SIMD
+  if (len >= 32 && HaveAVX2()) {
+    return FindSyntaxAVX2(s, len);
+  }
+  return FindSyntaxSSE2(s, len);
+#else
+  return FindSyntaxPlain(s, 0, len);
+#endif
+}
+
+int ByteScan::FindNonAscii(const char* s, int len) {
+  int i = 0;
+#ifdef TILTON_X86_SIMD
+  for (; i + 16 <= len; i += 16) {
+    int mask = _mm_movemask_epi8(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i)));
+    if (mask) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+#endif
+  for (; i < len; i += 1) {
+    if (s[i] & 0x80) {
+      return i;
+    }
+  }
+  return len;
+}
+
+int ByteScan::NextCharacter(const char* s, int len, int i) {
+  int c;
+  c = s[i] & 0xFF;
+  i += 1;
+  if (c >= 0xC0) {
+    if (c < 0xE0) {  // 2-byte form
+      // <= jr 18Sep11
+      if ((i + 1) <= len && ((s[i] & 0xC0) == 0x80)) {
+        i += 1;
+      }
+    } else if (c < 0xF0) {  // 3-byte form
+      // <= jr 18Sep11
+      if ((i + 2) <= len &&
+          ((s[i]     & 0xC0) == 0x80) &&
+          ((s[i + 1] & 0xC0) == 0x80)) {
+        i += 2;
+      }
+    } else {  // 4-byte form
+      // <= jr 18Sep11
+      if ((i + 3) <= len &&
+          ((s[i]     & 0xC0) == 0x80) &&
+          ((s[i + 1] & 0xC0) == 0x80) &&
+          ((s[i + 2] & 0xC0) == 0x80)) {
+        i += 3;
+      }
+    }
+  }
+  return i;
+}
+
+// When every multibyte character is well formed, the characters are the
+// bytes that are not continuation bytes (10xxxxxx), which SSE2 can count 16
+// at a time. A block is well formed when its continuation bytes are exactly
+// the ones that the lead bytes before them call for. A block that is not is
+// stepped through with NextCharacter, which decides what a bad byte means.
+#ifdef TILTON_X86_SIMD
+
+static inline __m128i AtLeast(__m128i v, __m128i bound) {
+  return _mm_cmpeq_epi8(_mm_max_epu8(v, bound), v);
+}
+
+#endif  // TILTON_X86_SIMD
+
+// A counted block can end inside a character whose continuation bytes are
+// in the next block. Back up to its lead byte, which was counted.
+static int BackUpToLead(const char* s, int i, int* count) {
+  for (int q = i - 1; q >= 0 && q >= i - 3; q -= 1) {
+    int c = s[q] & 0xFF;
+    if ((c & 0xC0) == 0x80) {
+      continue;
+    }
+    if (c >= 0xC0) {
+      int length = c < 0xE0 ? 2 : c < 0xF0 ? 3 : 4;
+      if (q + length > i) {
+        *count -= 1;
+        return q;
+      }
+    }
+    break;
+  }
+  return i;
+}
+
+int ByteScan::CountCharacters(const char* s, int len) {
+  int count = 0;
+  int i = 0;
+  bool counted = false;   // the block before i was counted as well formed
+#ifdef TILTON_X86_SIMD
+  const __m128i top   = _mm_set1_epi8(static_cast<char>(0xC0));
+  const __m128i cont  = _mm_set1_epi8(static_cast<char>(0x80));
+  const __m128i lead2 = _mm_set1_epi8(static_cast<char>(0xC0));
+  const __m128i lead3 = _mm_set1_epi8(static_cast<char>(0xE0));
+  const __m128i lead4 = _mm_set1_epi8(static_cast<char>(0xF0));
+  __m128i previous = _mm_setzero_si128();
+  while (i + 16 <= len) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+    __m128i back1 = _mm_or_si128(_mm_slli_si128(v, 1),
+                                 _mm_srli_si128(previous, 15));
+    __m128i back2 = _mm_or_si128(_mm_slli_si128(v, 2),
+                                 _mm_srli_si128(previous, 14));
+    __m128i back3 = _mm_or_si128(_mm_slli_si128(v, 3),
+                                 _mm_srli_si128(previous, 13));
+    __m128i is_cont = _mm_cmpeq_epi8(_mm_and_si128(v, top), cont);
+    __m128i wanted = _mm_or_si128(_mm_or_si128(AtLeast(back1, lead2),
+                                               AtLeast(back2, lead3)),
+                                  AtLeast(back3, lead4));
+    if (_mm_movemask_epi8(_mm_xor_si128(is_cont, wanted)) == 0) {
+      count += 16 - __builtin_popcount(_mm_movemask_epi8(is_cont));
+      previous = v;
+      counted = true;
+      i += 16;
+    } else {
+      int end = i + 16;
+      if (counted) {
+        i = BackUpToLead(s, i, &count);
+      }
+      while (i < end) {
+        i = NextCharacter(s, len, i);
+        count += 1;
+      }
+      // the bytes before i are not known to be well formed
+      previous = _mm_setzero_si128();
+      counted = false;
+    }
+  }
+#endif
+  if (counted) {
+    i = BackUpToLead(s, i, &count);
+  }
+  while (i < len) {
+    i = NextCharacter(s, len, i);
+    count += 1;
+  }
+  return count;
+}
+
+bool ByteScan::IsPlainText(const char* s, int len) {
+  int i = 0;
+  for (;;) {
+    i += FindSyntax(s + i, len - i);
+    if (i >= len) {
+      return true;
+    }
+    if (s[i] == EOT) {
+      return false;
+    }
+    if (i + 1 < len) {
+      if (s[i] == '<' && s[i + 1] == '~') {
+        return false;
+      }
+      if (s[i] == '~' && s[i + 1] == '>') {
+        return false;
+      }
+    }
+    i += 1;
+  }
+}
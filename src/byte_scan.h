@@ -0,0 +1,45 @@
+// Copyright (c) 2011 Revelux Labs, LLC. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+#ifndef SRC_BYTE_SCAN_H_
+#define SRC_BYTE_SCAN_H_
+
+// ByteScan -- searches that look at many bytes at a time.
+//  On x86 the searches use SSE2, or AVX2 when the processor has it.
+//  Elsewhere they fall back to a plain loop.
+
+class ByteScan {
+ public:
+  // FindSyntax
+  // Returns the index of the first byte that means something to the
+  // scanner: < or ~ or a byte that reads as EOT. Returns len if none.
+  static int  FindSyntax(const char* s, int len);
+
+  // IsPlainText
+  // Tests to determine if a text has no <~, no ~> and no EOT, so that
+  // evaluating it produces the text itself
+  static bool IsPlainText(const char* s, int len);
+
+  // FindNonAscii
+  // Returns the index of the first byte with the high bit set, or len
+  static int  FindNonAscii(const char* s, int len);
+
+  // IsAscii
+  // Tests to determine if every byte is ASCII
+  static bool IsAscii(const char* s, int len) {
+    return FindNonAscii(s, len) == len;
+  }
+
+  // NextCharacter
+  // Returns the index of the UTF-8 character after the one at i. If a
+  // multibyte character is badly formed, its first byte is taken to be a
+  // character by itself.
+  static int  NextCharacter(const char* s, int len, int i);
+
+  // CountCharacters
+  // Returns the number of characters as NextCharacter steps through them
+  static int  CountCharacters(const char* s, int len);
+};
+
+#endif  // SRC_BYTE_SCAN_H_
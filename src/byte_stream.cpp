@@ -6,6 +6,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "tilton.h"
 #include "text.h"
@@ -72,3 +73,30 @@ int ByteStream::peek() {
         return EOF;
     }
 }
+
+// skip over a run of characters. memchr finds the line ends; a run that
+// contains a \r takes the slow way so that \r\n counts once.
+
+void ByteStream::Skip(int count) {
+    if (text_ == NULL || count <= 0) {
+      return;
+    }
+    const char* s = text_->string_ + index_;
+    if (memchr(s, '\r', count)) {
+      while (count > 0) {
+        next();
+        count -= 1;
+      }
+      return;
+    }
+    const char* end = s + count;
+    const char* last = NULL;
+    const char* p = s;
+    while ((p = static_cast<const char*>(memchr(p, '\n', end - p)))) {
+      line_ += 1;
+      last = p;
+      p += 1;
+    }
+    character_ = last ? static_cast<int>(end - last - 1) : character_ + count;
+    index_ += count;
+}
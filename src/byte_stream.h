@@ -25,6 +25,10 @@ class ByteStream {
   int     next();
   int     peek();
 
+  // Skip
+  // Advance over count characters, counting lines as next() would
+  void    Skip(int count);
+
 private:
   int     character_;
   int     index_;      // position in byte stream
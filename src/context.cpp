@@ -6,54 +6,204 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
 
+#include <vector>
+
+#include "byte_scan.h"
+#include "file_writer.h"
 #include "function.h"
-#include "byte_stream.h"
 #include "macro.h"
 #include "node.h"
 #include "hash_table.h"
+#include "output_buffer.h"
+#include "program.h"
+#include "symbol.h"
 #include "tilton.h"
 #include "text.h"
 
-Context::Context(Context* prev, ByteStream* s) {
-    position_ = 0;
-    first_ = NULL;
-    last_ = NULL;
-    previous_ = prev;
-    source_ = s;
-    if (s) {
-        line_ = s->line();
-        character_ = s->character();
-        index_ = s->index();
-    } else {
-        line_ = 0;
-        character_ = 0;
-        index_ = 0;
+// The default is deeper than a recursion through the C stack could go, and
+// shallow enough that a runaway recursion stops while the contexts it holds
+// open, each well under a kilobyte, still fit in memory. A recursion whose
+// arguments or output grow at each level is stopped by its bytes instead.
+int Context::depth_ = 0;
+int Context::depth_limit_ = 100000;
+long Context::held_ = 0;
+
+// Frame -- a program running on the evaluation stack.
+//  The contexts from context back to, but not including, base belong to
+//  the frame and are deleted when it finishes. A call in tail position
+//  reuses the frame of its caller, so its chain can hold several contexts:
+//  a context stays open while a later one has an argument to evaluate in
+//  it. The contexts closed early still count towards the depth, so a
+//  runaway tail recursion stops too.
+
+struct Frame {
+  Program* program;   // retained
+  int      pc;
+  Context* context;
+  Context* base;
+  int      closed;    // contexts of the chain closed before it finished
+};
+
+void Context::FinishFrame(Frame* frame) {
+  frame->program->Release();
+  Context* c = frame->context;
+  while (c != frame->base) {
+    Context* previous = c->previous_;
+    delete c;
+    c = previous;
+  }
+  depth_ -= frame->closed;
+}
+
+// Only the two newest contexts are looked at, which is enough to keep the
+// chain of a tail recursion short whether a level evaluates its arguments
+// before or after the call that follows it. The oldest kShownCalls of the
+// chain are kept for error reports, which show the outermost calls.
+int Context::CloseChain(Context* newest, Context* base) {
+  Context* c = newest;
+  for (int i = 0; i < 2 && c != base; i += 1) {
+    if (c->IsSettled()) {
+      int older = 0;
+      for (Context* o = c->previous_; o != base; o = o->previous_) {
+        older += 1;
+      }
+      int closed = older - kShownCalls;
+      if (closed <= 0) {
+        return 0;
+      }
+      Context* old = c->previous_;
+      for (int j = 0; j < closed; j += 1) {
+        Context* previous = old->previous_;
+        delete old;
+        old = previous;
+      }
+      c->previous_ = old;
+      c->elided_ = true;
+      depth_ += closed;
+      return closed;
+    }
+    c = c->previous_;
+  }
+  return 0;
+}
+
+bool Context::IsSettled() {
+  for (int i = 0; i < argument_count_; i += 1) {
+    Node* n = arguments_[i];
+    if (n->value_ == NULL && n->hasText() &&
+        (n->text_ ? !ByteScan::IsPlainText(n->text_->string_,
+                                           n->text_->length_)
+                  : !ByteScan::IsPlainText(n->span_, n->span_length_))) {
+      return false;
     }
+  }
+  return true;
+}
+
+Context::Context(Context* prev, Text* source) {
+    depth_ += 1;
+    bytes_ = sizeof(Context);
+    held_ += bytes_;
+    program_ = NULL;
+    tail_ = NULL;
+    arguments_ = inline_arguments_;
+    argument_count_ = 0;
+    argument_capacity_ = kInlineArguments;
+    previous_ = prev;
+    elided_ = false;
+    source_ = source;
+    line_ = 0;
+    character_ = 0;
+    index_ = 0;
+}
+
+Context::Context(Context* prev, Text* source, int line, int character,
+                 int index) {
+    depth_ += 1;
+    bytes_ = sizeof(Context);
+    held_ += bytes_;
+    program_ = NULL;
+    tail_ = NULL;
+    arguments_ = inline_arguments_;
+    argument_count_ = 0;
+    argument_capacity_ = kInlineArguments;
+    previous_ = prev;
+    elided_ = false;
+    source_ = source;
+    line_ = line;
+    character_ = character;
+    index_ = index;
+}
+
+Context::Context(Context* prev, Program* program, int line, int character,
+                 int index) {
+    depth_ += 1;
+    bytes_ = sizeof(Context);
+    held_ += bytes_;
+    program_ = program;
+    program_->Retain();
+    tail_ = NULL;
+    arguments_ = inline_arguments_;
+    argument_count_ = 0;
+    argument_capacity_ = kInlineArguments;
+    previous_ = prev;
+    elided_ = false;
+    source_ = program->source();
+    line_ = line;
+    character_ = character;
+    index_ = index;
 }
 
+// The nodes live in arena_, which frees them when it is destroyed.
+
 Context::~Context() {
-    delete this->first_;
+    for (int i = 0; i < argument_count_; i += 1) {
+        arguments_[i]->~Node();
+    }
+    if (program_) {
+        program_->Release();
+    }
+    depth_ -= 1;
+    held_ -= bytes_;
 }
 
 void Context::AddArgument(const char* s) {
-    AddArgument(new Text(s));
+    AddArgument(s, static_cast<int>(strlen(s)));
 }
 
 void Context::AddArgument(Text* t) {
-    Node* p = new Node(t);
-    if (last_) {
-        last_->next_ = p;
-    } else {
-        first_ = p;
+    AddNode(new(arena_.Allocate(sizeof(Node))) Node(t));
+}
+
+void Context::AddArgument(const char* s, int len) {
+    AddNode(new(arena_.Allocate(sizeof(Node))) Node(s, len));
+}
+
+// The first kInlineArguments nodes are held in the Context itself. Beyond
+// that the array doubles into the arena; the nodes themselves never move.
+
+void Context::AddNode(Node* p) {
+    if (argument_count_ == argument_capacity_) {
+        argument_capacity_ *= 2;
+        Node** grown = static_cast<Node**>(
+            arena_.Allocate(argument_capacity_ * sizeof(Node*)));
+        memmove(grown, arguments_, argument_count_ * sizeof(Node*));
+        arguments_ = grown;
     }
-    last_ = p;
+    arguments_[argument_count_] = p;
+    argument_count_ += 1;
 }
 
 
 void Context::DumpContext() {
-    if (first_) {
-        first_->WriteNode();
+    for (int i = 0; i < argument_count_; i += 1) {
+        if (i) {
+            fputc('~', stderr);
+        }
+        arguments_[i]->WriteNode();
     }
     fputc('\n', stderr);
 }
@@ -75,182 +225,194 @@ void Context::ReportErrorAndDie(const char* reason, Text* evidence) {
         report->AddToString(evidence);
     }
     report->AddToString(".\n");
+    // the files written so far are finished before the run stops
+    if (!FileWriter::instance()->Flush()) {
+        report->AddToString("Error in writing file: ");
+        report->AddToString(FileWriter::instance()->failed());
+        report->AddToString(".\n");
+    }
     fwrite(report->string_, sizeof(char), report->length_, stdout);
     fwrite(report->string_, sizeof(char), report->length_, stderr);
     exit(1);
 }
 
 // Eval is the heart of Tilton, see comment in context.h
-// It is currently being refactored towards the command pattern.
 void Context::ParseAndEvaluate(Text* input, Text* &the_output) {
-  int c;                 // current character
-  int depth = 0;         // depth of nested <~ ~>
-  int tildes_seen= 0;     // the number of tildes in the separator ~~~
-  Context* new_context = NULL;
-  ByteStream* in = new ByteStream(input);
-
-  // Loop over the characters in the input
-
-  for (;;) {
-    switch ((c = in->next())) {
-      case '<':
-        this->ParseLeftAngle(in, depth, the_output,
-                                tildes_seen, new_context);
-        break;
-      case '~':
-        this->ParseTilde(in, depth, the_output, tildes_seen, new_context);
-        break;
-      case EOT:
-        this->ParseEOT(in, depth, the_output, tildes_seen, new_context);
-        return;
-      // literal character
-      default:
-        the_output->AddToString(c);
-        break;
-    }
+  // a missing argument evaluates to nothing, and text without <~, ~> or
+  // EOT evaluates to itself
+  if (input == NULL) {
+    return;
   }
-}
-
-void Context::ParseLeftAngle(ByteStream* in, int &depth, Text* &the_output,
-                        int &tildes_seen, Context* &new_context) {
-  int run_length;  // the number of tildes currently under consideration
-
-  run_length = checkForTilde(in, 0);
-
-  if (!stackEmpty(depth)) {       // in middle of macro expansion
-    if (haveTildes(run_length)) {  // found embedded macro bracket
-        depth += 1;
-    }
-    the_output->AddToString('<');
-    the_output->AddToString('~', run_length);
-  } else if (haveTildes(run_length)) {  // found first macro bracket
-    depth = 1;
-    tildes_seen = run_length;
-    new_context = new Context(this, in);
-    new_context->position_ = the_output->length_;
-  } else {  // left angle in the middle of text being passed through
-    the_output->AddToString('<');
+  if (ByteScan::IsPlainText(input->string_, input->length_)) {
+    the_output->AddToString(input);
+    return;
   }
+  Program program(input);
+  EvaluateProgram(&program, the_output);
 }
 
-void Context::ParseTilde(ByteStream* in, int &depth, Text* &the_output,
-                        int &tildes_seen, Context* &new_context) {
-  int arg_number;    // argument number
-  Node* arg;         // current arg
-  Text* arg_text;    // current text
-  int run_length;    // the number of tildes currently under consideration
-
-  run_length = checkForTilde(in, 1);
-
-  // if in middle of expansion and tildes seen, create args for each
-  if (depth == 1 && run_length >= tildes_seen) {
-    new_context->AddArgument(
-        the_output->RemoveFromString(new_context->position_));
-    for (;;) {
-      run_length -= tildes_seen;
-      if (run_length < tildes_seen) {
+void Context::EvaluateProgram(Program* program, Text* &the_output) {
+  std::vector<Frame> stack;
+  Text* value;
+  int position;
+  OutputBuffer* output = OutputBuffer::instance();
+
+  CheckStack();
+  program->Retain();
+  Frame first = { program, 0, this, this, 0 };
+  stack.push_back(first);
+  while (!stack.empty()) {
+    output->Spill(the_output);
+    Frame& frame = stack.back();
+    const std::vector<Instruction>& code = frame.program->instructions();
+    int end = static_cast<int>(code.size());
+    if (frame.pc == end) {
+      FinishFrame(&frame);
+      stack.pop_back();
+      continue;
+    }
+    const Instruction& op = code[frame.pc];
+    Context* context = frame.context;
+    frame.pc += 1;
+    switch (op.opcode) {
+      // literal run
+      case Instruction::kLiteral:
+        the_output->AddToString(frame.program->characters(op.start),
+                                op.length);
+        break;
+      //    <~NUMBER~>
+      case Instruction::kParameter:
+        the_output->AddToString(
+            context->EvaluateArgument(op.number, the_output));
+        break;
+      //    <~NUMBER~value~>
+      case Instruction::kSetParameter: {
+        const Span& arg = frame.program->argument(op.first_arg + 1);
+        Text text(frame.program->characters(arg.start), arg.length);
+        position = the_output->length_;
+        output->BeginCapture();
+        context->ParseAndEvaluate(&text, the_output);
+        output->EndCapture();
+        value = the_output->RemoveFromString(position);
+        context->SetMacroVariable(op.number, value);
+        delete value;
         break;
       }
-      new_context->AddArgument(new Text());
-    }
-  }
-
-  // pass through tildes in plain text
-  the_output->AddToString('~', run_length);
-
-  // if we have seen the closing bracket
-  if (in->peek() == '>') {
-    //  ~>
-    in->next();
-    if (!stackEmpty(depth)) {
-      depth -= 1;
-      if (!stackEmpty(depth)) {
-          the_output->AddToString('>');
-      } else {
-        if (run_length) {
-          new_context->ReportErrorAndDie("Short ~>");
-        }
-        //    apply:
-        arg = new_context->first_;
-        //    <~NUMBER~>
-        arg_text = arg->text_;
-        arg_number = arg_text->GetCharacter(0) - '0';
-        if (Text::isDigit(arg_number)) {
-          arg_number = arg_text->ConvertAlphaToInteger();
-          if (arg_number >= 0) {
-            if (!arg->next_) {
-              the_output->AddToString(this->EvaluateArgument(arg_number, the_output));
-            } else {
-              //    <~NUMBER~value~>
-              arg = new_context->GetArgument(arg_number);
-              if (!arg->hasValue()) {
-                arg = this->EvalTextForArg(1, new_context, the_output);
-              }
-              this->SetMacroVariable(arg_number, arg->value_);
-            }
-            delete new_context;
-            return;
+      //    look up
+      case Instruction::kCall: {
+        Context* new_context = new Context(context, frame.program, op.line,
+                                           op.character, op.index);
+        new_context->AddCallArguments(frame.program, op);
+        Context* run_in;
+        Program* next = context->EvaluateMacro(new_context, op.symbol,
+                                               the_output, &run_in);
+        if (next) {
+          Frame callee = { next, 0, run_in, context, 0 };
+          if (frame.pc == end) {
+            // nothing is left for the caller to do: take over its frame,
+            // and close the contexts that nothing will look into again
+            callee.base = frame.base;
+            callee.closed = frame.closed + CloseChain(run_in, frame.base);
+            frame.program->Release();
+            frame = callee;
+          } else {
+            stack.push_back(callee);
           }
         }
-        //    look up
-        Context::EvaluateMacro(new_context, the_output);
+        break;
+      }
+      case Instruction::kError: {
+        Context new_context(context, frame.program, op.line, op.character,
+                            op.index);
+        new_context.AddCallArguments(frame.program, op);
+        new_context.ReportErrorAndDie(op.error);
+        break;
       }
-    } else {
-      (new Context(this, in))->ReportErrorAndDie("Extra ~>");
     }
   }
 }
 
-Node* Context::EvalTextForArg(int arg_number, Context* &new_context,
-                             Text* &the_output) {
-  Node* n;
-  n = new_context->GetArgument(arg_number);
-  this->ParseAndEvaluate(n->text_, the_output);
-  n->value_ = the_output->RemoveFromString(new_context->position_);
-  return n;
+// Evaluation is iterative except where a builtin needs the value of an
+// argument, which nests a call of EvaluateProgram. The C stack is checked
+// there so that running out of it is an error rather than a crash.
+void Context::CheckStack() {
+  static const char* base = NULL;
+  static long limit = 0;
+  char here;
+
+  if (base == NULL) {
+    struct rlimit rl;
+    long size = 8L << 20;
+    if (getrlimit(RLIMIT_STACK, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY) {
+      size = static_cast<long>(rl.rlim_cur);
+    }
+    base = &here;
+    limit = size - size / 4;
+  }
+  long used = base > &here ? base - &here : &here - base;
+  if (used > limit) {
+    ReportErrorAndDie("Too deep");
+  }
+}
+
+void Context::AddCallArguments(Program* program, const Instruction& call) {
+  for (int i = 0; i < call.arg_count; i += 1) {
+    const Span& arg = program->argument(call.first_arg + i);
+    AddArgument(program->characters(arg.start), arg.length);
+  }
 }
 
 void Context::SetMacroVariable(int varNo, Text* t) {
   Node* o;
   o = this->GetArgument(varNo);
-  delete o->text_;
-  o->text_ = NULL;
+  o->ClearText();
   delete o->value_;
   // o->value[varNo] = new Text(t);
   // previous bug fix -- jr 19Sep11
   o->value_ = new Text(t);
 }
 
-void Context::EvaluateMacro(Context* &new_context, Text* &the_output) {
-  Macro* macro;
-  Text* name;
-  Builtin function;
+Program* Context::EvaluateMacro(Context* new_context, Symbol* symbol,
+                                Text* &the_output, Context** run_in) {
+  Macro* macro = NULL;
+  Program* next = NULL;
 
-  name = new_context->EvaluateArgument(kArgZero, the_output);
+  if (depth_ > depth_limit_ ||
+      (depth_ > kDeepStack &&
+       held_ + OutputBuffer::instance()->length() > kHeldLimit)) {
+    new_context->ReportErrorAndDie("Too deep");
+  }
+  if (!symbol) {
+    Text* name = new_context->EvaluateArgument(kArgZero, the_output);
+    symbol = MacroTable::instance()->macro_table()->LookupSymbol(name);
+  }
   // look for name as built in
-  function = FunctionContext::instance()->GetFunction(name->string_);
-  if (function) {
-    (*function)(new_context, the_output);
+  if (symbol && symbol->builtin_) {
+    (*symbol->builtin_)(new_context, the_output);
+    Node* tail = new_context->tail_;
+    if (tail) {
+      // the argument is evaluated here, as EvaluateArgument would
+      next = new_context->program_->Subprogram(tail->span_,
+                                               tail->span_length_);
+      *run_in = this;
+    }
+    delete new_context;
   } else {
     // look for macro definition
-    macro = MacroTable::instance()->macro_table()->LookupMacro(name);
+    if (symbol) {
+      macro = symbol->macro_;
+    }
     if (macro) {
-      new_context->ParseAndEvaluate(new Text(macro), the_output);
+      // the macro may be redefined while its program runs
+      next = macro->program();
+      next->Retain();
+      *run_in = new_context;
     } else {
       //    undefined
       new_context->ReportErrorAndDie("Undefined macro");
     }
   }
-  delete new_context;
-  new_context = NULL;
-}
-
-void Context::ParseEOT(ByteStream* in, int &depth, Text* &the_output,
-                      int &tildes_seen, Context* &new_context) {
-    if (!stackEmpty(depth)) {
-        new_context->ReportErrorAndDie("Missing ~>");
-    }
-    delete in;
+  return next;
 }
 
 Text* Context::EvaluateArgument(int argNr, Text* &the_output) {
@@ -263,18 +425,49 @@ Text* Context::EvaluateArgument(Node* n, Text* &the_output) {
       return NULL;
   }
   if (n->value_ == NULL) {
-    if (n->text_ == NULL) {
+    if (!n->hasText()) {
       return NULL;
     }
-    Text* arg = n->text_;
-    int position_ = the_output->length_;
-    this->previous_->ParseAndEvaluate(arg, the_output);
-    n->value_ = the_output->RemoveFromString(position_);
+    if (n->text_ == NULL &&
+        ByteScan::IsPlainText(n->span_, n->span_length_)) {
+      // an argument without <~ ~> is its own value
+      n->value_ = new Text(n->span_, n->span_length_, true);
+    } else {
+      Text span(n->span_, n->span_length_, true);
+      Text* arg = n->text_ ? n->text_ : &span;
+      int position_ = the_output->length_;
+      OutputBuffer::instance()->BeginCapture();
+      this->previous_->ParseAndEvaluate(arg, the_output);
+      OutputBuffer::instance()->EndCapture();
+      n->value_ = the_output->RemoveFromString(position_);
+    }
+    Hold(n->value_->length_);
   }
   return n->value_;
 }
 
 
+void Context::EvaluateInTail(int argNr, Text* &the_output) {
+  Node* n = GetArgument(argNr);
+  if (n->value_ || n->text_ || !n->hasText() || !program_ ||
+      ByteScan::IsPlainText(n->span_, n->span_length_)) {
+    the_output->AddToString(EvaluateArgument(n, the_output));
+  } else {
+    tail_ = n;
+  }
+}
+
+
+Program* Context::ArgumentProgram(int argNr) {
+  Node* n = GetArgument(argNr);
+  if (program_ && n->span_) {
+    return program_->Subprogram(n->span_, n->span_length_);
+  }
+  Text* text = n->text();
+  return new Program(text ? new Text(text) : new Text(), true);
+}
+
+
 number Context::EvaluateNumber(int argNr, Text* &the_output) {
   return EvaluateNumber(GetArgument(argNr), the_output);
 }
@@ -293,39 +486,51 @@ number Context::EvaluateNumber(Node* n, Text* &the_output) {
 
 
 Node* Context::GetArgument(int argNr) {
-  Node* p;
-  if (!first_) {
-    first_ = last_ = new Node(NULL);
-  }
-  p = first_;
-  for (;;) {
-    if (!argNr) {
-      return p;
-    }
-    p = p->next_;
-    if (!p) {
-      p = new Node(NULL);
-      last_->next_ = p;  // fixed <~1~> bug -- jr 17Aug11
-      last_ = p;
-    }
-    argNr -= 1;
+  while (argument_count_ <= argNr) {
+    AddNode(new(arena_.Allocate(sizeof(Node))) Node(NULL));
   }
+  return arguments_[argNr];
 }
 
 void Context::ResetArgument(int argNr) {
   Node* n;
   n = this->GetArgument(argNr);
+  if (n->value_) {
+    long held = bytes_ - static_cast<long>(sizeof(Context));
+    Hold(-(n->value_->length_ < held ? n->value_->length_ : held));
+  }
   delete n->value_;
   n->value_ = NULL;
 }
 
 
+// The outermost and innermost calls are enough to place an error in a deep
+// recursion, so a long chain is shortened in the middle.
 void Context::FindError(Text* report) {
-  if (previous_) {
-    previous_->FindError(report);
+  std::vector<Context*> chain;
+  for (Context* c = this; c; c = c->previous_) {
+    chain.push_back(c);
   }
+  int count = static_cast<int>(chain.size());
+  bool gap = false;
+  for (int i = count - 1; i >= 0; i -= 1) {
+    if (count > 2 * kShownCalls && i == count - kShownCalls - 1) {
+      gap = true;
+      i = kShownCalls - 1;
+    }
+    if (gap) {
+      report->AddToString("... ");
+      gap = false;
+    }
+    chain[i]->AddPosition(report);
+    // the calls closed by a tail call are left out like the middle
+    gap = i > 0 && chain[i - 1]->elided_;
+  }
+}
+
+void Context::AddPosition(Text* report) {
   if (source_) {
-    report->AddToString(source_->text()->name_, source_->text()->name_length_);
+    report->AddToString(source_->name_, source_->name_length_);
     report->AddToString('(');
     report->AddNumberToString(line_ + 1);
     report->AddToString(',');
@@ -335,9 +540,10 @@ void Context::FindError(Text* report) {
     report->AddToString(") ");
   }
   // add first_ jr 4Sep11
-  if (first_ && first_->text_ && first_->text_->length_) {
+  Node* first = argument(kArgZero);
+  if (first && first->text() && first->text_->length_) {
     report->AddToString("<~");
-    report->AddToString(first_->text_);
+    report->AddToString(first->text_);
     report->AddToString("~> ");
   }
 }
@@ -5,32 +5,48 @@
 #ifndef SRC_CONTEXT_H_
 #define SRC_CONTEXT_H_
 
+#include "arena.h"
 #include "tilton.h"
-#include "byte_stream.h"
 
-class ByteStream;
-class Text;
+struct Frame;
+struct Instruction;
 class Node;
+class Program;
+class Symbol;
+class Text;
 
 // Context -- a stack frame for evaluation.
 //  Context is the key datastructure in Tilton. It keeps a collection of
-//  parameters in numbered slots. We keep in each slot a raw string
-//  and an evaluated value (for memoization).
+//  parameters in numbered slots, so finding one is an index. We keep in
+//  each slot a raw string and an evaluated value (for memoization).
 
 //  A Context can point to a previous context, which allows contexts to be
 //  nested. A Context can also include source information for use in error
 //  messages.
 
+//  The nodes of a Context come from its own Arena and are freed with it.
+//  The Context of a call is made by EvaluateProgram, which runs macro
+//  bodies on an explicit stack of frames rather than on the C stack, so
+//  that a deep recursion costs a Context and a frame per level.
+
 
 class Context {
  public:
-  Context(Context*, ByteStream*);
+  Context(Context* previous, Text* source);
+  Context(Context* previous, Text* source, int line, int character,
+          int index);
+  // A call made by program, whose source holds the argument spans
+  Context(Context* previous, Program* program, int line, int character,
+          int index);
   virtual ~Context();
 
   // AddArgument
   // Add an argument to a frame
+  // A string argument is not copied, so it must outlive the context
   void    AddArgument(const char* s);
   void    AddArgument(Text* t);
+  // Add an argument that is a view of len characters of the source
+  void    AddArgument(const char* s, int len);
 
   // DumpContext
   // Print info about the args in a frame
@@ -48,8 +64,15 @@ class Context {
   //  in the new context as argument strings. Any nested <~ ~> sequences within
   //  the arguments are treated for now as literal (lazy evaluation). The [0]
   //  argument is the name of the macro to be invoked.
+  //  The scanning is done by compiling the input into a Program.
   void    ParseAndEvaluate(Text* input, Text* &the_output);
 
+  // EvaluateProgram
+  // Run a compiled text in this context. Macro calls push a frame on an
+  // explicit stack; a call that is the last instruction of its program
+  // takes over the frame of its caller.
+  void    EvaluateProgram(Program* program, Text* &the_output);
+
   // EvaluateArgument
   // Evaluate an argument of a macro. If we have already determined its
   // value, then simply return it. Otherwise, evaluate the argument to obtain
@@ -57,14 +80,35 @@ class Context {
   Text*   EvaluateArgument(const int argNr, Text* &the_output);
   Text*   EvaluateArgument(Node* n, Text* &the_output);
 
+  // EvaluateInTail
+  // Produce the value of an argument as the last act of a builtin. The
+  // argument is run on the evaluation stack in place of the call, so a
+  // conditional that selects a recursive call does not nest.
+  void    EvaluateInTail(const int argNr, Text* &the_output);
+
+  // ArgumentProgram
+  // The compiled text of an argument, for a builtin that evaluates it
+  // many times. The reference is retained.
+  Program* ArgumentProgram(const int argNr);
+
   number  EvaluateNumber(const int argNr, Text* &the_output);
   number  EvaluateNumber(Node* n, Text* &the_output);
 
   // GetArgument
-  // Retrieves an argument
+  // Retrieves an argument, adding empty ones up to it if needed
   // Arguments are stored as nodes on the frame.
   Node*   GetArgument(const int argNr);
 
+  // argument
+  // Retrieves an argument, or NULL if there is no such argument
+  Node*   argument(int argNr) {
+    return argNr < argument_count_ ? arguments_[argNr] : NULL;
+  }
+
+  // argument_count
+  // The number of arguments, including the name
+  int     argument_count() { return argument_count_; }
+
   void    nop();
 
   //  ResetArgument
@@ -73,54 +117,60 @@ class Context {
   //  This is used by <~loop~>
   void    ResetArgument(const int argNr);
 
-  Node*   first_;
+  // set_depth_limit
+  // Set the number of contexts that may be open at once
+  static void set_depth_limit(int limit) { depth_limit_ = limit; }
+
   Context* previous_;
 
  private:
+  // AddNode
+  // Append a node to the argument list
+  void AddNode(Node* p);
+
   // FindError
-  // Recurse through the stack frames to find the location of the error
+  // Walk back through the stack frames to find the location of the error
   void FindError(Text* report);
 
-  // ParseLeftAngle
-  // Parse and eval the text following a left angle bracket
-  void ParseLeftAngle(ByteStream* in, int &depth, Text* &the_output,
-                         int &tildes_seen, Context* &new_context);
-
-  // ParseTilde
-  void ParseTilde(ByteStream* in, int &depth, Text* &the_output,
-                     int &tildes_seen, Context* &new_context);
-
-  // ParseEOT
-  void ParseEOT(ByteStream* in, int &depth, Text* &the_output,
-                   int &tildes_seen, Context* &new_context);
+  // AddPosition
+  // Add the position and name of this call to an error report
+  void AddPosition(Text* report);
 
   // EvaluateMacro
-  void EvaluateMacro(Context* &new_context, Text* &the_output);
-
-  // stackEmpty
-  // Tests to determine if the eval stack is empty
-  bool stackEmpty(const int depth) const { return depth == 0; }
-
-  // checkForTilde
-  // Examines the input stream for a run of tildes
-  // Returns the number of consecutive tildes at the beginning
-  // of the stream and removes them
-  int checkForTilde(ByteStream* in, int no) {
-    while (in->next() == '~') {
-      no += 1;
-    }
-    in->back();
-    return no;
-  }
-
-  // haveTildes
-  // Tests to determine if we have a run of tildes
-  bool haveTildes(const int run_length) const { return run_length > 0; }
-
-  // EvalTextForArg
-  // Evaluate a text and produce a value, store in an argument
-  Node* EvalTextForArg(const int arg_number, Context* &new_context,
-                       Text* &the_output);
+  // Call a builtin or a macro. The symbol is the name when the call
+  // already knows it, or NULL to evaluate the name. Returns the program
+  // that the evaluation stack must run to finish the call, setting run_in
+  // to the context to run it in, or NULL when the call is complete.
+  Program* EvaluateMacro(Context* new_context, Symbol* symbol,
+                         Text* &the_output, Context** run_in);
+
+  // FinishFrame
+  // Release the program of a frame and delete its contexts
+  static void FinishFrame(Frame* frame);
+
+  // CloseChain
+  // Delete the contexts of a frame's chain, older than newest and newer
+  // than base, that no open argument can refer to. Returns how many were
+  // deleted.
+  static int CloseChain(Context* newest, Context* base);
+
+  // IsSettled
+  // Tests to determine if every argument has its value or needs no
+  // evaluation, so that the previous context is not needed for them
+  bool    IsSettled();
+
+  // Hold
+  // Count bytes of argument values as held by this context, or no longer
+  // held if negative
+  void    Hold(long bytes) { bytes_ += bytes; held_ += bytes; }
+
+  // CheckStack
+  // Die before a nested evaluation could exhaust the C stack
+  void CheckStack();
+
+  // AddCallArguments
+  // Add the argument spans of a call instruction of a program
+  void AddCallArguments(Program* program, const Instruction& call);
 
   // setMacroVariable
   // Sets a digit macro to a value
@@ -129,9 +179,25 @@ class Context {
   int     character_;
   int     index_;
   int     line_;
-  int     position_;
-  ByteStream*   source_;
-  Node*   last_;
+  bool    elided_;            // contexts before this one were closed
+  static const int kInlineArguments = 8;
+  static const int kShownCalls = 32;  // the calls shown at each end
+  static const int kDeepStack = 10000;  // the depth kHeldLimit applies from
+  static const long kHeldLimit = 512L << 20;  // held and output by a deep stack
+
+  Text*   source_;
+  Program* program_;          // retained: the source of the argument spans
+  Node*   tail_;              // set by EvaluateInTail
+  Node**  arguments_;         // inline_arguments_ until there are more
+  int     argument_count_;
+  int     argument_capacity_;
+  Node*   inline_arguments_[kInlineArguments];
+  Arena   arena_;
+  long    bytes_;             // this context and the argument values it holds
+
+  static int depth_;          // the number of contexts open
+  static int depth_limit_;
+  static long held_;          // the bytes of all the contexts open
 };
 
 #endif  // SRC_CONTEXT_H_
@@ -0,0 +1,214 @@
+// Copyright (c) 2011 Revelux Labs, LLC. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+#include "file_cache.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "byte_scan.h"
+#include "file_writer.h"
+#include "mapped_file.h"
+#include "program.h"
+#include "text.h"
+
+std::set<CachedFile*>* CachedFile::mapped_ = NULL;
+std::map<std::string, CachedFile*>* FileCache::files_ = NULL;
+CachedFile* FileCache::newest_ = NULL;
+CachedFile* FileCache::oldest_ = NULL;
+long FileCache::size_ = 0;
+
+CachedFile::CachedFile() {
+  text_ = new Text();
+  mapping_ = NULL;
+  program_ = NULL;
+  compiled_ = false;
+  references_ = 1;
+  device_ = 0;
+  inode_ = 0;
+  newer_ = NULL;
+  older_ = NULL;
+}
+
+CachedFile::~CachedFile() {
+  if (program_) {
+    program_->Release();
+  }
+  delete text_;
+  if (mapping_) {
+    mapped_->erase(this);
+    delete mapping_;
+  }
+}
+
+bool CachedFile::Load(Text* name) {
+  std::string path(name->string_, name->length_);
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  mapping_ = new MappedFile();
+  bool mapped = mapping_->Map(fd);
+  close(fd);
+  if (mapped) {
+    text_->Borrow(mapping_->data(), mapping_->length());
+    text_->set_name(name);
+    if (mapped_ == NULL) {
+      mapped_ = new std::set<CachedFile*>();
+    }
+    mapped_->insert(this);
+    return true;
+  }
+  delete mapping_;
+  mapping_ = NULL;
+  return text_->ReadFromFile(name);
+}
+
+int CachedFile::Open() const {
+  if (mapping_ == NULL) {
+    return -1;
+  }
+  int fd = open(name_.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd >= 0 && (fstat(fd, &st) != 0 || device_ != st.st_dev ||
+                  inode_ != st.st_ino || size_ != st.st_size ||
+                  seconds_ != st.st_mtim.tv_sec ||
+                  nanoseconds_ != st.st_mtim.tv_nsec)) {
+    close(fd);
+    fd = -1;
+  }
+  return fd;
+}
+
+Program* CachedFile::program() {
+  if (!compiled_) {
+    compiled_ = true;
+    if (!ByteScan::IsPlainText(text_->string_, text_->length_)) {
+      program_ = new Program(text_);
+      program_->Keep();
+    }
+  }
+  return program_;
+}
+
+void CachedFile::Release() {
+  references_ -= 1;
+  if (references_ == 0) {
+    delete this;
+  }
+}
+
+CachedFile* FileCache::Find(Text* name) {
+  if (files_ == NULL) {
+    files_ = new std::map<std::string, CachedFile*>();
+  }
+  // a write still queued for the file must land before it is read
+  FileWriter::instance()->Wait(name);
+  std::string key(name->string_, name->length_);
+  struct stat st;
+  bool regular = stat(key.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+  std::map<std::string, CachedFile*>::iterator found = files_->find(key);
+  CachedFile* file = found == files_->end() ? NULL : found->second;
+  if (file) {
+    if (regular && file->device_ == st.st_dev && file->inode_ == st.st_ino &&
+        file->size_ == st.st_size && file->seconds_ == st.st_mtim.tv_sec &&
+        file->nanoseconds_ == st.st_mtim.tv_nsec) {
+      // move it to the front of the list
+      if (file != newest_) {
+        file->newer_->older_ = file->older_;
+        if (file->older_) {
+          file->older_->newer_ = file->newer_;
+        } else {
+          oldest_ = file->newer_;
+        }
+        file->newer_ = NULL;
+        file->older_ = newest_;
+        newest_->newer_ = file;
+        newest_ = file;
+      }
+      file->Retain();
+      return file;
+    }
+    Forget(file);
+  }
+
+  file = new CachedFile();
+  if (!file->Load(name)) {
+    file->Release();
+    return NULL;
+  }
+  // a file that is not a regular one, such as a pipe, may say something
+  // else next time, so it is not kept
+  if (!regular) {
+    return file;
+  }
+  file->device_ = st.st_dev;
+  file->inode_ = st.st_ino;
+  file->size_ = st.st_size;
+  file->seconds_ = st.st_mtim.tv_sec;
+  file->nanoseconds_ = st.st_mtim.tv_nsec;
+  file->name_ = key;
+  if (file->text_->length_ > kLimit) {
+    return file;
+  }
+  file->older_ = newest_;
+  if (newest_) {
+    newest_->newer_ = file;
+  } else {
+    oldest_ = file;
+  }
+  newest_ = file;
+  (*files_)[key] = file;
+  size_ += file->text_->length_;
+  file->Retain();
+  while (size_ > kLimit) {
+    Forget(oldest_);
+  }
+  return file;
+}
+
+void FileCache::Changed(Text* name) {
+  if (files_ == NULL) {
+    return;
+  }
+  std::map<std::string, CachedFile*>::iterator found =
+      files_->find(std::string(name->string_, name->length_));
+  if (found != files_->end()) {
+    Forget(found->second);
+  }
+}
+
+// The file is known by its inode, so a mapping read under another name,
+// such as another hard link, is found too.
+void FileCache::CopyOut(Text* name) {
+  struct stat st;
+  if (CachedFile::mapped_ == NULL ||
+      stat(std::string(name->string_, name->length_).c_str(), &st) != 0) {
+    return;
+  }
+  std::set<CachedFile*>::iterator f;
+  for (f = CachedFile::mapped_->begin(); f != CachedFile::mapped_->end();
+       ++f) {
+    if ((*f)->IsFile(st)) {
+      (*f)->mapping_->Detach();
+    }
+  }
+}
+
+void FileCache::Forget(CachedFile* file) {
+  if (file->newer_) {
+    file->newer_->older_ = file->older_;
+  } else {
+    newest_ = file->older_;
+  }
+  if (file->older_) {
+    file->older_->newer_ = file->newer_;
+  } else {
+    oldest_ = file->newer_;
+  }
+  files_->erase(file->name_);
+  size_ -= file->text_->length_;
+  file->Release();
+}
@@ -0,0 +1,130 @@
+// Copyright (c) 2011 Revelux Labs, LLC. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+#ifndef SRC_FILE_CACHE_H_
+#define SRC_FILE_CACHE_H_
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <map>
+#include <set>
+#include <string>
+
+class MappedFile;
+class Program;
+class Text;
+
+// CachedFile -- the contents of a file, shared by everyone who reads it.
+//  The text, and the program compiled from it for include, must not be
+//  changed. A CachedFile is reference counted: the cache holds one
+//  reference while it keeps the file, and each user holds one while it
+//  reads it, so a file dropped from the cache lives until it is released.
+
+class CachedFile {
+ public:
+  // text
+  // The contents of the file, named for error messages
+  Text*   text() const { return text_; }
+
+  // program
+  // The compiled text, compiled the first time it is asked for, or NULL
+  // if the text has no <~ ~> and evaluates to itself
+  Program* program();
+
+  // mapped
+  // True if the text is borrowed from a mapping of the file
+  bool    mapped() const { return mapping_ != NULL; }
+
+  // IsFile
+  // True if st describes the file that was read, whatever it holds now
+  bool    IsFile(const struct stat& st) const {
+    return mapping_ != NULL && device_ == st.st_dev && inode_ == st.st_ino;
+  }
+
+  // Open
+  // Open the file again for reading, or return -1 if it has changed since
+  // it was read
+  int     Open() const;
+
+  // Retain, Release
+  // Take a reference, or drop one, deleting the file with the last
+  void    Retain() { references_ += 1; }
+  void    Release();
+
+ private:
+  CachedFile();
+  virtual ~CachedFile();
+
+  // Load
+  // Map the file, or read it if it cannot be mapped
+  bool    Load(Text* name);
+
+  Text*       text_;          // borrows from mapping_, if it is mapped
+  MappedFile* mapping_;
+  Program*    program_;
+  bool        compiled_;       // program_ has been worked out
+  int         references_;
+
+  // every file read from a mapping, cached or not, while it lives
+  static std::set<CachedFile*>* mapped_;
+
+  // what the file was when it was read
+  dev_t       device_;
+  ino_t       inode_;
+  off_t       size_;
+  time_t      seconds_;
+  long        nanoseconds_;
+
+  // the list of cached files, from the most recently used
+  std::string name_;
+  CachedFile* newer_;
+  CachedFile* older_;
+
+  friend class FileCache;
+};
+
+// FileCache -- the files read by include, read, -include and -read, kept
+//  for reuse.
+//  A file is known by its name. Each time it is asked for, it is checked
+//  with a stat, and it is read again if its inode, size or time of
+//  modification has changed. Files included many times in a run are thus
+//  read once and compiled once. A regular file is mapped rather than
+//  copied.
+
+//  The texts kept are limited to kLimit bytes in all. When they pass it,
+//  the files used least recently are dropped; a file bigger than the
+//  limit is read for its user but not kept.
+
+class FileCache {
+ public:
+  // Find
+  // The file named, retained, or NULL if it cannot be read
+  static CachedFile* Find(Text* name);
+
+  // Changed
+  // Forget the file named, because it has just been written. Its time of
+  // modification may not have moved on if it was read a moment ago.
+  static void Changed(Text* name);
+
+  // CopyOut
+  // Detach every mapping of the file named from the file, before it is
+  // written over. A program compiled from it, or an include still running
+  // it, keeps its text even if the file is emptied in place.
+  static void CopyOut(Text* name);
+
+ private:
+  // Forget
+  // Drop a file from the cache
+  static void Forget(CachedFile* file);
+
+  static const long kLimit = 64L << 20;
+
+  static std::map<std::string, CachedFile*>* files_;
+  static CachedFile* newest_;
+  static CachedFile* oldest_;
+  static long size_;
+};
+
+#endif  // SRC_FILE_CACHE_H_
@@ -0,0 +1,235 @@
+// Copyright (c) 2011 Revelux Labs, LLC. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+#include "file_writer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "text.h"
+
+FileWriter* FileWriter::pInstance = 0;
+
+FileWriter* FileWriter::instance() {
+  if ( pInstance == 0 ) {
+    pInstance = new FileWriter;
+  }
+  return pInstance;
+}
+
+FileWriter::FileWriter() {
+  pthread_mutex_init(&lock_, NULL);
+  pthread_cond_init(&queued_, NULL);
+  pthread_cond_init(&done_, NULL);
+  size_ = 0;
+  started_ = false;
+  idle_ = false;
+  waiting_ = 0;
+  failed_ = NULL;
+  mode_t mask = umask(0);
+  umask(mask);
+  mode_ = 0666 & ~mask;
+}
+
+FileWriter::~FileWriter() {
+  delete failed_;
+}
+
+void FileWriter::Write(Text* name, const char* data, int length) {
+  Job* job = new Job;
+  job->path.assign(name->string_, name->length_);
+  job->data.assign(data, length);
+
+  pthread_mutex_lock(&lock_);
+  if (!started_) {
+    pthread_t thread;
+    started_ = pthread_create(&thread, NULL, Work, this) == 0;
+    if (started_) {
+      pthread_detach(thread);
+    }
+  }
+  if (!started_) {
+    // without a thread, the file is written now
+    if (!WriteFile(*job) && failed_path_.empty()) {
+      failed_path_ = job->path;
+    }
+    pthread_mutex_unlock(&lock_);
+    delete job;
+    return;
+  }
+  while (!jobs_.empty() && size_ + length > kLimit) {
+    WaitForWriter();
+  }
+  jobs_.push_back(job);
+  size_ += length;
+  pending_[job->path] += 1;
+  if (idle_) {
+    pthread_cond_signal(&queued_);
+  }
+  pthread_mutex_unlock(&lock_);
+}
+
+void FileWriter::Wait(Text* name) {
+  pthread_mutex_lock(&lock_);
+  if (!pending_.empty()) {
+    std::string path(name->string_, name->length_);
+    while (pending_.count(path) > 0 || IsPending(path)) {
+      WaitForWriter();
+    }
+  }
+  pthread_mutex_unlock(&lock_);
+}
+
+// A file can have several names, through hard or symbolic links, so the
+// file named is compared with each file a job is for.
+bool FileWriter::IsPending(const std::string& path) {
+  struct stat st;
+  if (pending_.empty() || stat(path.c_str(), &st) != 0) {
+    return false;
+  }
+  std::map<std::string, int>::iterator p;
+  for (p = pending_.begin(); p != pending_.end(); ++p) {
+    struct stat other;
+    if (stat(p->first.c_str(), &other) == 0 && other.st_dev == st.st_dev &&
+        other.st_ino == st.st_ino) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool FileWriter::Flush() {
+  pthread_mutex_lock(&lock_);
+  while (!jobs_.empty()) {
+    WaitForWriter();
+  }
+  std::string failed;
+  failed.swap(failed_path_);
+  pthread_mutex_unlock(&lock_);
+  if (failed.empty()) {
+    return true;
+  }
+  delete failed_;
+  failed_ = new Text(failed.data(), static_cast<int>(failed.size()));
+  return false;
+}
+
+void FileWriter::WaitForWriter() {
+  waiting_ += 1;
+  pthread_cond_wait(&done_, &lock_);
+  waiting_ -= 1;
+}
+
+// The temporary file is put where a rename can move it over the file: in
+// the same directory, under a short name, so that any name that can be
+// written to can be written to this way.
+int FileWriter::Open(const std::string& path, std::string* temp) {
+  temp->clear();
+  struct stat st;
+  bool exists = lstat(path.c_str(), &st) == 0;
+  if (exists && (!S_ISREG(st.st_mode) || st.st_nlink > 1)) {
+    // a device, a pipe or a link is written through, in place, and so is
+    // a file with other names, which must see the new text too
+    return OpenInPlace(path);
+  }
+  std::string::size_type slash = path.rfind('/');
+  std::string directory = slash == std::string::npos ? ""
+                          : path.substr(0, slash + 1);
+  std::vector<char> name(directory.begin(), directory.end());
+  const char base[] = ".tiltonXXXXXX";
+  name.insert(name.end(), base, base + sizeof(base));
+  int fd = mkstemp(&name[0]);
+  if (fd < 0) {
+    // a directory that cannot be written to may hold a file that can be
+    return OpenInPlace(path);
+  }
+  if (exists && (st.st_uid != geteuid() || st.st_gid != getegid()) &&
+      fchown(fd, st.st_uid, st.st_gid) != 0) {
+    // a file that would change hands is written in place instead
+    close(fd);
+    unlink(&name[0]);
+    return OpenInPlace(path);
+  }
+  temp->assign(&name[0]);
+  // mkstemp makes a file only its owner can read
+  fchmod(fd, exists ? st.st_mode & 07777 : mode_);
+  return fd;
+}
+
+int FileWriter::OpenInPlace(const std::string& path) {
+  return open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+}
+
+bool FileWriter::Close(int fd, const std::string& path,
+                       const std::string& temp, bool written) {
+  bool ok = close(fd) == 0 && written;
+  if (!temp.empty()) {
+    ok = ok && rename(temp.c_str(), path.c_str()) == 0;
+    if (!ok) {
+      unlink(temp.c_str());
+    }
+  }
+  return ok;
+}
+
+bool FileWriter::WriteFile(const Job& job) {
+  std::string temp;
+  int fd = Open(job.path, &temp);
+  if (fd < 0) {
+    return false;
+  }
+  const char* data = job.data.data();
+  size_t left = job.data.size();
+  while (left > 0) {
+    ssize_t written = write(fd, data, left);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      break;
+    }
+    data += written;
+    left -= static_cast<size_t>(written);
+  }
+  return Close(fd, job.path, temp, left == 0);
+}
+
+void* FileWriter::Work(void* writer) {
+  FileWriter* self = static_cast<FileWriter*>(writer);
+  pthread_mutex_lock(&self->lock_);
+  for (;;) {
+    while (self->jobs_.empty()) {
+      self->idle_ = true;
+      pthread_cond_wait(&self->queued_, &self->lock_);
+    }
+    self->idle_ = false;
+    // the job stays in the queue until it is done, so that Flush and Wait
+    // wait for it
+    Job* job = self->jobs_.front();
+    pthread_mutex_unlock(&self->lock_);
+    bool ok = self->WriteFile(*job);
+    pthread_mutex_lock(&self->lock_);
+    if (!ok && self->failed_path_.empty()) {
+      self->failed_path_ = job->path;
+    }
+    self->jobs_.pop_front();
+    self->size_ -= static_cast<long>(job->data.size());
+    std::map<std::string, int>::iterator pending =
+        self->pending_.find(job->path);
+    pending->second -= 1;
+    if (pending->second == 0) {
+      self->pending_.erase(pending);
+    }
+    delete job;
+    if (self->waiting_ > 0) {
+      pthread_cond_broadcast(&self->done_);
+    }
+  }
+  return NULL;
+}
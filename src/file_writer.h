@@ -0,0 +1,122 @@
+// Copyright (c) 2011 Revelux Labs, LLC. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+#ifndef SRC_FILE_WRITER_H_
+#define SRC_FILE_WRITER_H_
+
+#include <pthread.h>
+#include <sys/types.h>
+
+#include <deque>
+#include <map>
+#include <string>
+
+class Text;
+
+// FileWriter -- singleton to write files while evaluation goes on.
+//  The write builtin hands its file to Write, which queues it and returns.
+//  A thread of its own opens, writes and closes the files in the order
+//  they were queued. The queue holds at most kLimit bytes; Write waits
+//  for room when it is full.
+
+//  A file is written to a temporary file beside it, which is renamed over
+//  it when it is complete, so that a reader never sees half a file, and a
+//  mapping of the old file is left as it was. The new file keeps the mode,
+//  owner and group of the old one.
+
+//  Where a rename would not do what writing the file does, the file is
+//  written in place, as it always was: a file that is not a regular one,
+//  such as /dev/stderr; a file with several hard links, whose other names
+//  would keep the old text; a file that belongs to someone else, who
+//  would lose it; and a file whose directory cannot take a temporary file,
+//  because it is read only or for any other reason. Whoever queues a
+//  write detaches the mappings of the file first, with OutputBuffer and
+//  FileCache CopyOut, so that emptying it in place takes no text away.
+
+//  A write that fails does not stop the run at once. The first failure is
+//  kept, and Flush, which waits for the queue to empty, reports it. Flush
+//  is called before -write, at the end of a run, and on an error. Reading
+//  a file waits for the writes queued for it by Wait.
+
+class FileWriter {
+ public:
+  FileWriter();
+  virtual ~FileWriter();
+
+  static FileWriter* instance();
+
+  // Write
+  // Queue the writing of length bytes of data to the file named
+  void    Write(Text* name, const char* data, int length);
+
+  // Wait
+  // Wait until the writes queued for the file named, under any of its
+  // names, are done
+  void    Wait(Text* name);
+
+  // Flush
+  // Wait until every write queued is done. Returns false if one failed,
+  // and failed names the first that did.
+  bool    Flush();
+  Text*   failed() const { return failed_; }
+
+  // Open
+  // Open a temporary file for the file named, setting temp to its name, or
+  // the file itself if it must be written in place, leaving temp empty.
+  // Returns the file descriptor, or -1.
+  int     Open(const std::string& path, std::string* temp);
+
+  // Close
+  // Close a file opened by Open, and put the temporary file in the place
+  // of the file named if it was written. Returns false if it fails.
+  bool    Close(int fd, const std::string& path, const std::string& temp,
+                bool written);
+
+ private:
+  // Job -- a file to be written
+  struct Job {
+    std::string path;
+    std::string data;
+  };
+
+  // Work
+  // Write the jobs in the queue, for ever
+  static void* Work(void* writer);
+
+  // WaitForWriter
+  // Wait, holding lock_, for the thread to finish a job
+  void    WaitForWriter();
+
+  // IsPending
+  // Tests, holding lock_, whether a job is queued for the file named
+  // under another name
+  bool    IsPending(const std::string& path);
+
+  // WriteFile
+  // Write a job, returning false if it fails
+  bool    WriteFile(const Job& job);
+
+  // OpenInPlace
+  // Open the file named itself, emptied, or made if it is not there
+  static int OpenInPlace(const std::string& path);
+
+  static const long kLimit = 16L << 20;
+
+  static FileWriter* pInstance;
+
+  pthread_mutex_t   lock_;
+  pthread_cond_t    queued_;      // a job was queued for an idle thread
+  pthread_cond_t    done_;        // a job was done
+  std::deque<Job*>  jobs_;        // the jobs waiting and the one being done
+  std::map<std::string, int> pending_;  // the number of jobs for each path
+  long              size_;        // the bytes in jobs_
+  bool              started_;     // the thread was started
+  bool              idle_;        // the thread is waiting for a job
+  int               waiting_;     // the callers waiting for a job to be done
+  std::string       failed_path_;  // the first write that failed, if any
+  Text*             failed_;       // failed_path_, as Flush found it
+  mode_t            mode_;        // the mode for new files, after the umask
+};
+
+#endif  // SRC_FILE_WRITER_H_
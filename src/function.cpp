@@ -28,6 +28,7 @@ void FunctionContext::RegisterTiltonFunctions() {
   RegisterFunction("add",       AddFunction::evaluate);
   RegisterFunction("and",       AndFunction::evaluate);
   RegisterFunction("append",    AppendFunction::evaluate);
+  RegisterFunction("count",     CountFunction::evaluate);
   RegisterFunction("define",    DefineFunction::evaluate);
   RegisterFunction("defined?",  DefinedFunction::evaluate);
   RegisterFunction("delete",    DeleteFunction::evaluate);
@@ -36,18 +37,24 @@ void FunctionContext::RegisterTiltonFunctions() {
   RegisterFunction("entityify", EntityifyFunction::evaluate);
   RegisterFunction("eq?",       EqFunction::evaluate);
   RegisterFunction("eval",      EvalFunction::evaluate);
+  RegisterFunction("field",     FieldFunction::evaluate);
   RegisterFunction("first",     FirstFunction::evaluate);
+  RegisterFunction("for",       ForFunction::evaluate);
+  RegisterFunction("foreach",   ForeachFunction::evaluate);
   RegisterFunction("ge?",       GeFunction::evaluate);
   RegisterFunction("gensym",    GensymFunction::evaluate);
   RegisterFunction("get",       GetFunction::evaluate);
   RegisterFunction("gt?",       GtFunction::evaluate);
   RegisterFunction("include",   IncludeFunction::evaluate);
+  RegisterFunction("index",     IndexFunction::evaluate);
+  RegisterFunction("jsonify",   JsonifyFunction::evaluate);
   RegisterFunction("last",      LastFunction::evaluate);
   RegisterFunction("le?",       LeFunction::evaluate);
   RegisterFunction("length",    LengthFunction::evaluate);
   RegisterFunction("literal",   LiteralFunction::evaluate);
   RegisterFunction("loop",      LoopFunction::evaluate);
   RegisterFunction("lt?",       LtFunction::evaluate);
+  RegisterFunction("match",     MatchFunction::evaluate);
   RegisterFunction("mod",       ModFunction::evaluate);
   RegisterFunction("mult",      MultFunction::evaluate);
   RegisterFunction("mute",      NullFunction::evaluate);
@@ -57,14 +64,18 @@ void FunctionContext::RegisterTiltonFunctions() {
   RegisterFunction("or",        OrFunction::evaluate);
   RegisterFunction("print",     PrintFunction::evaluate);
   RegisterFunction("read",      ReadFunction::evaluate);
+  RegisterFunction("regex-replace", RegexReplaceFunction::evaluate);
   RegisterFunction("rep",       RepFunction::evaluate);
+  RegisterFunction("replace",   ReplaceFunction::evaluate);
   RegisterFunction("set",       SetFunction::evaluate);
   RegisterFunction("slashify",  SlashifyFunction::evaluate);
+  RegisterFunction("sort",      SortFunction::evaluate);
   RegisterFunction("stop",      StopFunction::evaluate);
   RegisterFunction("sub",       SubFunction::evaluate);
   RegisterFunction("substr",    SubstrFunction::evaluate);
   RegisterFunction("trim",      TrimFunction::evaluate);
   RegisterFunction("unicode",   UnicodeFunction::evaluate);
+  RegisterFunction("urlencode", UrlencodeFunction::evaluate);
   RegisterFunction("write",     WriteFunction::evaluate);
 }
 
@@ -5,14 +5,20 @@
 #ifndef SRC_FUNCTION_H_
 #define SRC_FUNCTION_H_
 
-#include <map>
-#include <string>
-
 #include "tilton.h"
+#include "byte_scan.h"
+#include "file_cache.h"
+#include "file_writer.h"
 #include "hash_table.h"
+#include "list_sort.h"
 #include "context.h"
 #include "node.h"
 #include "macro.h"
+#include "output_buffer.h"
+#include "program.h"
+#include "regex.h"
+#include "substring_search.h"
+#include "transform.h"
 
 
 // FunctionContext -- collection of functions available as built-ins
@@ -24,34 +30,17 @@ class FunctionContext {
   
   static FunctionContext* instance();
   
-  std::map<std::string, Builtin>& functions() {
-    static std::map<std::string, Builtin>  functions_;
-    return functions_;
-  }
-  
   // registerTiltonFunctions
   // Register the built-in functions for use in Tilton
   void RegisterTiltonFunctions();
 
-  Builtin GetFunction(std::string name) {
-    it_ = functions().find(name);
-    if (it_ != functions().end()) {
-      return it_->second;
-    } else {
-      return NULL;
-    }
-  }
-  
  private:
-  void RegisterFunction(std::string name, Builtin function) {
-    functions().insert(std::make_pair(name, function));
+  // The built-ins live in the symbols of the macro table
+  void RegisterFunction(const char* name, Builtin function) {
+    MacroTable::instance()->macro_table()->InstallBuiltin(name, function);
   }
   
   static FunctionContext*  pInstance;
-  
-  // Container for built ins  
-//  std::map<std::string, Builtin>  functions_;
-  std::map<std::string, Builtin>::const_iterator it_;
 };
 
 class ArithmeticFunction {
@@ -64,26 +53,19 @@ class ArithmeticFunction {
   // to implement the tilton arithmetic functions.
   static void reduce(Context* context, number num,
                      number (*f)(number, number), Text* &the_output) {
-     Node* n = context->first_->next_;
-     if (n) {
-         if (num == kNAN) {
-             num = context->EvaluateNumber(n, the_output);
-             n = n->next_;
-         }
-         if (n) {
-             for (;;) {
-                 if (!n) {
-                     break;
-                 }
-                 number d = context->EvaluateNumber(n, the_output);
-                 if (num == kNAN || d == kNAN) {
-                     num = kNAN;
-                     break;
-                 }
-                 num = f(num, d);
-                 n = n->next_;
-             }
+     int count = context->argument_count();
+     int i = kArgOne;
+     if (i < count && num == kNAN) {
+         num = context->EvaluateNumber(i, the_output);
+         i += 1;
+     }
+     for (; i < count; i += 1) {
+         number d = context->EvaluateNumber(i, the_output);
+         if (num == kNAN || d == kNAN) {
+             num = kNAN;
+             break;
          }
+         num = f(num, d);
      }
      the_output->AddNumberToString(num);
   }
@@ -116,34 +98,27 @@ class BooleanFunction {
 
   //  test - This is used to implement the tilton binary conditional functions.
   static void test(Context* context, int (*f)(Text*, Text*), Text* &the_output) {
-     Node* c;
-     Node* t;
-     Node* s = context->first_->next_;
-     if (!s) {
+     int count = context->argument_count();
+     if (count <= kArgOne) {
          context->ReportErrorAndDie("No parameters");
          return;
      }
-     Text* swich = context->EvaluateArgument(s, the_output);
-     c = s->next_;
-     if (!c) {
-         context->ReportErrorAndDie("Too few parameters");
-     }
-     t = c->next_;
-     if (!t) {
+     Text* swich = context->EvaluateArgument(kArgOne, the_output);
+     if (count <= kArgThree) {
          context->ReportErrorAndDie("Too few parameters");
      }
+     int c = kArgTwo;   // the case
      for (;;) {
          if (f(swich, context->EvaluateArgument(c, the_output))) {  // then
-             the_output->AddToString(context->EvaluateArgument(t, the_output));
+             context->EvaluateInTail(c + 1, the_output);
              return;
          }
-         c = t->next_;
-         if (!c) {
+         c += 2;
+         if (c >= count) {
              return;  // empty else
          }
-         t = c->next_;
-         if (!t) {    // else
-             the_output->AddToString(context->EvaluateArgument(c, the_output));
+         if (c + 1 >= count) {    // else
+             context->EvaluateInTail(c, the_output);
              return;
          }
      }
@@ -192,14 +167,12 @@ class AndFunction {
   virtual ~AndFunction();
 
   static void evaluate(Context* context, Text* &the_output) {
-    Node* n = context->first_->next_;
     Text* t = NULL;
-    while (n) {
-        t = context->EvaluateArgument(n, the_output);
+    for (int i = kArgOne; i < context->argument_count(); i += 1) {
+        t = context->EvaluateArgument(i, the_output);
         if (t->length_ == 0) {
             return;
         }
-        n = n->next_;
     }
     the_output->AddToString(t);
   }
@@ -212,24 +185,48 @@ class AppendFunction {
   virtual ~AppendFunction();
 
   static void evaluate(Context* context, Text* &the_output) {
-    Node* n = context->first_->next_;
-    if (n == NULL) {
+    if (context->argument_count() <= kArgOne) {
         context->ReportErrorAndDie("Missing name");
     }
-    Text* name = context->EvaluateArgument(n, the_output);
+    Text* name = context->EvaluateArgument(kArgOne, the_output);
     if (name->length_ < 1) {
         context->ReportErrorAndDie("Missing name");
     }
 
     Macro* t = MacroTable::instance()->macro_table()->GetMacroDefOrInsertNull(name);
 
-    for (;;) {
-        n = n->next_;
-        if (!n) {
+    for (int i = kArgTwo; i < context->argument_count(); i += 1) {
+        t->AddToString(context->EvaluateArgument(i, the_output));
+    }
+  }
+};
+
+// CountFunction -- Function object for built-in function
+class CountFunction {
+ public:
+  CountFunction();
+  virtual ~CountFunction();
+
+  static void evaluate(Context* context, Text* &the_output) {
+    Text* t = context->EvaluateArgument(kArgOne, the_output);
+    SubstringSearch needles;
+    for (int i = kArgTwo; i < context->argument_count(); i += 1) {
+        Text* needle = context->EvaluateArgument(i, the_output);
+        needles.AddNeedle(needle->string_, needle->length_);
+    }
+    number count = 0;
+    int which;
+    int i = 0;
+    while (t) {
+        int r = needles.FindFirst(t->string_ + i, t->length_ - i, &which);
+        if (r < 0) {
             break;
         }
-        t->AddToString(context->EvaluateArgument(n, the_output));
+        count += 1;
+        i += r + context->EvaluateArgument(kArgTwo + which,
+                                           the_output)->length_;
     }
+    the_output->AddNumberToString(count);
   }
 };
 
@@ -241,8 +238,10 @@ class DefineFunction {
 
   static void evaluate(Context* context, Text* &the_output) {
     int position = the_output->length_;
-    the_output->AddToString(context->GetArgument(kArgTwo)->text_);
+    OutputBuffer::instance()->BeginCapture();
+    the_output->AddToString(context->GetArgument(kArgTwo)->text());
     Text* name = context->EvaluateArgument(kArgOne, the_output);
+    OutputBuffer::instance()->EndCapture();
     if (name->length_ < 1) {
         context->ReportErrorAndDie("Missing name");
     }
@@ -258,10 +257,9 @@ class DefinedFunction {
   virtual ~DefinedFunction();
 
   static void evaluate(Context* context, Text* &the_output) {
-  the_output->AddToString(
-      context->EvaluateArgument(
+  context->EvaluateInTail(
         MacroTable::instance()->macro_table()->
-        LookupMacro(context->EvaluateArgument(kArgOne, the_output)) ? kArgTwo : kArgThree, the_output));
+        LookupMacro(context->EvaluateArgument(kArgOne, the_output)) ? kArgTwo : kArgThree, the_output);
   }
 };
 
@@ -272,25 +270,9 @@ class DeleteFunction {
   virtual ~DeleteFunction();
 
   static void evaluate(Context* context, Text* &the_output) {
-  Node* n = context->first_->next_;
-  while (n) {
-    Text* name = context->EvaluateArgument(n, the_output);
-    Macro* t = MacroTable::instance()->macro_table()->LookupMacro(name);
-    Macro* u = NULL;
-    while (t) {
-      if (t->IsNameEqual(name)) {
-        if (u) {
-          u->link_ = t->link_;
-        } else {
-          MacroTable::instance()->macro_table()->InstallMacro(name, t->link_);
-        }
-        delete t;
-        break;
-      }
-      u = t;
-      t = t->link_;
-    }
-    n = n->next_;
+    for (int i = kArgOne; i < context->argument_count(); i += 1) {
+      Text* name = context->EvaluateArgument(i, the_output);
+      MacroTable::instance()->macro_table()->DeleteMacro(name);
     }
   }
 };
@@ -314,6 +296,9 @@ class DumpFunction {
 
   static void evaluate(Context* context, Text* &the_output) {
     MacroTable::instance()->macro_table()->PrintMacroTable();
+    if (context->argument_count() > kArgOne) {
+      MacroTable::instance()->macro_table()->PrintStatistics();
+    }
   }
 };
 
@@ -325,37 +310,8 @@ class EntityifyFunction {
 
   static void evaluate(Context* context, Text* &the_output) {
     Text* t = context->EvaluateArgument(kArgOne, the_output);
-    int c;
-    int i;
     if (t && t->length_) {
-        for (i = 0; i < t->length_; i += 1) {
-            c = t->GetCharacter(i);
-            switch (c) {
-                case '&':
-                    the_output->AddToString("&amp;");
-                    break;
-                case '<':
-                    the_output->AddToString("&lt;");
-                    break;
-                case '>':
-                    the_output->AddToString("&gt;");
-                    break;
-                case '"':
-                    the_output->AddToString("&quot;");
-                    break;
-                case '\'':
-                    the_output->AddToString("&#039;");
-                    break;
-                case '\\':
-                    the_output->AddToString("&#092;");
-                    break;
-                case '~':
-                    the_output->AddToString("&#126;");
-                    break;
-                default:
-                    the_output->AddToString(c);
-            }
-        }
+        Transform::Entityify().Apply(t->string_, t->length_, the_output);
     }
   }
 };
@@ -378,17 +334,64 @@ class EvalFunction {
   virtual ~EvalFunction();
 
   static void evaluate(Context* context, Text* &the_output) {
-    Context* new_context = new Context(context, NULL);
-    new_context->AddArgument("eval");
-    new_context->AddArgument("<~2~>");
-    new_context->AddArgument("<~3~>");
-    new_context->AddArgument("<~4~>");
-    new_context->AddArgument("<~5~>");
-    new_context->AddArgument("<~6~>");
-    new_context->AddArgument("<~7~>");
-    new_context->AddArgument("<~8~>");
-    new_context->ParseAndEvaluate(context->GetArgument(kArgOne)->text_, the_output);
-    delete new_context;
+    Context new_context(context, NULL);
+    new_context.AddArgument("eval");
+    new_context.AddArgument("<~2~>");
+    new_context.AddArgument("<~3~>");
+    new_context.AddArgument("<~4~>");
+    new_context.AddArgument("<~5~>");
+    new_context.AddArgument("<~6~>");
+    new_context.AddArgument("<~7~>");
+    new_context.AddArgument("<~8~>");
+    new_context.ParseAndEvaluate(context->GetArgument(kArgOne)->text(), the_output);
+  }
+};
+
+// FieldFunction -- Function object for built-in function
+class FieldFunction {
+ public:
+  FieldFunction();
+  virtual ~FieldFunction();
+
+  static void evaluate(Context* context, Text* &the_output) {
+    if (context->argument_count() <= kArgTwo) {
+        context->ReportErrorAndDie("Too few parameters");
+    }
+    Text* t = context->EvaluateArgument(kArgOne, the_output);
+    number k = context->EvaluateNumber(kArgTwo, the_output);
+    SubstringSearch delimiters;
+    for (int i = kArgThree; i < context->argument_count(); i += 1) {
+        Text* d = context->EvaluateArgument(i, the_output);
+        delimiters.AddNeedle(d->string_, d->length_);
+    }
+    if (t == NULL || k == 0) {
+        return;
+    }
+
+    // the fields are found from the left; a negative k counts from the
+    // right, so every field is found
+    std::vector<int> fields;    // the start and length of each field
+    int which;
+    int i = 0;
+    for (;;) {
+        int r = delimiters.FindFirst(t->string_ + i, t->length_ - i, &which);
+        int length = r < 0 ? t->length_ - i : r;
+        if (k > 0 && static_cast<number>(fields.size() / 2) == k - 1) {
+            the_output->AddToString(t->string_ + i, length);
+            return;
+        }
+        fields.push_back(i);
+        fields.push_back(length);
+        if (r < 0) {
+            break;
+        }
+        i += length + context->EvaluateArgument(kArgThree + which,
+                                                the_output)->length_;
+    }
+    number n = static_cast<number>(fields.size() / 2) + k;
+    if (k < 0 && n >= 0) {
+        the_output->AddToString(t->string_ + fields[n * 2], fields[n * 2 + 1]);
+    }
   }
 };
 
@@ -399,8 +402,8 @@ class FirstFunction {
   virtual ~FirstFunction();
 
   static void evaluate(Context* context, Text* &the_output) {
-    Node* arg = context->first_->next_;
-    Text* name = context->EvaluateArgument(arg, the_output);
+    Text* name = context->EvaluateArgument(context->argument(kArgOne),
+                                           the_output);
     if (name->length_ < 1) {
         context->ReportErrorAndDie("Missing name: first");
     }
@@ -411,29 +414,119 @@ class FirstFunction {
     }
     Text* d = NULL;
     int   len = 0;
-    int   r = macro->length_;
-    for (;;) {
-        arg= arg->next_;
-        if (!arg) {
-            break;
-        }
-        int index = macro->FindFirstSubstring(context->EvaluateArgument(arg, the_output));
-        if (index >= 0 && index < r) {
-            r = index;
-            d = context->EvaluateArgument(arg, the_output);
-            len = d->length_;
-        }
+    int   which;
+    SubstringSearch delimiters;
+    for (int i = kArgTwo; i < context->argument_count(); i += 1) {
+        Text* t = context->EvaluateArgument(i, the_output);
+        delimiters.AddNeedle(t->string_, t->length_);
+    }
+    int   r = delimiters.FindFirst(macro->definition_, macro->length_, &which);
+    if (r < 0) {
+        r = macro->length_;
+    } else {
+        d = context->EvaluateArgument(kArgTwo + which, the_output);
+        len = d->length_;
     }
     the_output->AddToString(macro->definition_, r);
     macro->ReplaceDefWithSubstring(r + len, macro->length_ - (r + len));
-    arg = context->previous_->GetArgument(kArgZero);
-    delete arg->text_;
-    arg->text_ = NULL;
+    Node* arg = context->previous_->GetArgument(kArgZero);
+    arg->ClearText();
     delete arg->value_;
     arg->value_ = d ? new Text(d) : NULL;
   }
 };
 
+// ForFunction -- Function object for built-in function
+class ForFunction {
+ public:
+  ForFunction();
+  virtual ~ForFunction();
+
+  static void evaluate(Context* context, Text* &the_output) {
+    if (context->argument_count() <= kArgThree) {
+        context->ReportErrorAndDie("Too few parameters");
+    }
+    number start = context->EvaluateNumber(kArgOne, the_output);
+    number end = context->EvaluateNumber(kArgTwo, the_output);
+    number step = context->EvaluateNumber(kArgThree, the_output);
+    if (step == 0) {
+        context->ReportErrorAndDie("Bad step",
+                                   context->EvaluateArgument(kArgThree,
+                                                             the_output));
+    }
+
+    // the counter stays a number; the body is compiled once and run in
+    // one context, where <~1~> is the counter
+    Program* body = context->ArgumentProgram(kArgFour);
+    Context counter_context(context, static_cast<Text*>(NULL));
+    counter_context.AddArgument("", 0);
+    Node* slot = counter_context.GetArgument(kArgOne);
+    for (number i = start; step > 0 ? i <= end : i >= end; i += step) {
+        if (slot->value_ == NULL) {
+            slot->value_ = new Text();
+        }
+        slot->value_->set_string(NULL, 0);
+        slot->value_->AddNumberToString(i);
+        counter_context.EvaluateProgram(body, the_output);
+        if (step > 0 ? end - i < step : end - i > step) {
+            break;    // the next step would pass the end, or overflow
+        }
+    }
+    body->Release();
+  }
+};
+
+// ForeachFunction -- Function object for built-in function
+class ForeachFunction {
+ public:
+  ForeachFunction();
+  virtual ~ForeachFunction();
+
+  static void evaluate(Context* context, Text* &the_output) {
+    Text* list = context->EvaluateArgument(kArgOne, the_output);
+    if (list == NULL || list->length_ == 0) {
+        return;
+    }
+
+    // split the list once; like a loop over first, a trailing delimiter
+    // does not make an empty last item
+    std::vector<int> items;   // the start and length of each item
+    SubstringSearch delimiters;
+    for (int i = kArgThree; i < context->argument_count(); i += 1) {
+        Text* t = context->EvaluateArgument(i, the_output);
+        delimiters.AddNeedle(t->string_, t->length_);
+    }
+    int which;
+    for (int i = 0; i < list->length_;) {
+        int r = delimiters.FindFirst(list->string_ + i, list->length_ - i,
+                                     &which);
+        int length = r < 0 ? list->length_ - i : r;
+        items.push_back(i);
+        items.push_back(length);
+        i += length;
+        if (r >= 0) {
+            i += context->EvaluateArgument(kArgThree + which,
+                                           the_output)->length_;
+        }
+    }
+
+    // the body is compiled once and run for each item in one context,
+    // where <~1~> is the item
+    Program* body = context->ArgumentProgram(kArgTwo);
+    Context item_context(context, static_cast<Text*>(NULL));
+    item_context.AddArgument("", 0);
+    Node* slot = item_context.GetArgument(kArgOne);
+    for (size_t n = 0; n < items.size(); n += 2) {
+        if (slot->value_ == NULL) {
+            slot->value_ = new Text();
+        }
+        slot->value_->set_string(list->string_ + items[n], items[n + 1]);
+        item_context.EvaluateProgram(body, the_output);
+    }
+    body->Release();
+  }
+};
+
 // GeFunction -- Function object for built-in function
 class GeFunction {
  public:
@@ -465,16 +558,14 @@ class GetFunction {
   virtual ~GetFunction();
 
   static void evaluate(Context* context, Text* &the_output) {
-    Node* n = context->first_->next_;
-    while (n) {
-        Text* name = context->EvaluateArgument(n, the_output);
+    for (int i = kArgOne; i < context->argument_count(); i += 1) {
+        Text* name = context->EvaluateArgument(i, the_output);
         Macro* macro = MacroTable::instance()->macro_table()->LookupMacro(name);
         if (macro) {
-            the_output->AddToString(new Text(macro));
+            the_output->AddToString(macro->definition_, macro->length_);
         } else {
             context->ReportErrorAndDie("Undefined variable", name);
         }
-        n = n->next_;
     }
   }
 };
@@ -497,25 +588,66 @@ class IncludeFunction {
   virtual ~IncludeFunction();
 
   static void evaluate(Context* context, Text* &the_output) {
-    // Node* n = context->first_->next_;
-    Text* string = new Text();
+    // the file is read and compiled once, and run from the cache
     Text* name = context->EvaluateArgument(kArgOne, the_output);
-    if (!string->ReadFromFile(name)) {
+    CachedFile* file = FileCache::Find(name);
+    if (file == NULL) {
         context->ReportErrorAndDie("Error in reading file", name);
     }
-    Context* new_context = new Context(context, NULL);
+    Context new_context(context, NULL);
+
+    new_context.AddArgument("include");
+    new_context.AddArgument("<~2~>");
+    new_context.AddArgument("<~3~>");
+    new_context.AddArgument("<~4~>");
+    new_context.AddArgument("<~5~>");
+    new_context.AddArgument("<~6~>");
+    new_context.AddArgument("<~7~>");
+    new_context.AddArgument("<~8~>");
+    Program* program = file->program();
+    if (program) {
+        new_context.EvaluateProgram(program, the_output);
+    } else {
+        OutputBuffer::instance()->AddFile(the_output, file);
+    }
+    file->Release();
+  }
+};
+
+// IndexFunction -- Function object for built-in function
+class IndexFunction {
+ public:
+  IndexFunction();
+  virtual ~IndexFunction();
 
-    new_context->AddArgument("include");
-    new_context->AddArgument("<~2~>");
-    new_context->AddArgument("<~3~>");
-    new_context->AddArgument("<~4~>");
-    new_context->AddArgument("<~5~>");
-    new_context->AddArgument("<~6~>");
-    new_context->AddArgument("<~7~>");
-    new_context->AddArgument("<~8~>");
-    new_context->ParseAndEvaluate(string, the_output);
-    delete new_context;
-    delete string;
+  static void evaluate(Context* context, Text* &the_output) {
+    Text* t = context->EvaluateArgument(kArgOne, the_output);
+    SubstringSearch needles;
+    for (int i = kArgTwo; i < context->argument_count(); i += 1) {
+        Text* needle = context->EvaluateArgument(i, the_output);
+        needles.AddNeedle(needle->string_, needle->length_);
+    }
+    int which;
+    int r = t ? needles.FindFirst(t->string_, t->length_, &which) : -1;
+    if (r >= 0) {
+        // counted in characters, as substr counts them
+        the_output->AddNumberToString(
+            ByteScan::CountCharacters(t->string_, r) + 1);
+    }
+  }
+};
+
+// JsonifyFunction -- Function object for built-in function
+class JsonifyFunction {
+ public:
+  JsonifyFunction();
+  virtual ~JsonifyFunction();
+
+  static void evaluate(Context* context, Text* &the_output) {
+    Text* t = context->EvaluateArgument(kArgOne, the_output);
+    if (t && t->length_) {
+        Transform::JsonEscape().Apply(t->string_, t->length_, the_output);
+    }
   }
 };
 
@@ -526,7 +658,6 @@ class LastFunction {
   virtual ~LastFunction();
 
   static void evaluate(Context* context, Text* &the_output) {
-    Node* n = context->first_->next_;
     Text* name = context->EvaluateArgument(kArgOne, the_output);
     if (name->length_ < 1) {
         context->ReportErrorAndDie("Missing name");
@@ -538,25 +669,25 @@ class LastFunction {
     }
     Text* d = NULL;
     int   len = 0;
-    int   r = 0;
-    for (;;) {
-        n = n->next_;
-        if (!n) {
-            break;
-        }
-        int index = macro->FindLastSubstring(context->EvaluateArgument(n, the_output));
-        if (index > r) {
-            r = index;
-            d = context->EvaluateArgument(n, the_output);
-            len = d->length_;
-        }
+    int   which;
+    SubstringSearch delimiters;
+    for (int i = kArgTwo; i < context->argument_count(); i += 1) {
+        Text* t = context->EvaluateArgument(i, the_output);
+        delimiters.AddNeedle(t->string_, t->length_);
+    }
+    // a delimiter at the very front does not count
+    int   r = delimiters.FindLast(macro->definition_, macro->length_, &which);
+    if (r <= 0) {
+        r = 0;
+    } else {
+        d = context->EvaluateArgument(kArgTwo + which, the_output);
+        len = d->length_;
     }
     the_output->AddToString(macro->definition_ + r + len,
                       macro->length_ - (r + len));
-    macro->length_ = r;
-    n = context->previous_->GetArgument(kArgZero);
-    delete n->text_;
-    n->text_ = NULL;
+    macro->ReplaceDefWithSubstring(0, r);
+    Node* n = context->previous_->GetArgument(kArgZero);
+    n->ClearText();
     delete n->value_;
     n->value_ = d ? new Text(d) : NULL;
   }
@@ -591,7 +722,7 @@ class LiteralFunction {
   virtual ~LiteralFunction();
 
   static void evaluate(Context* context, Text* &the_output) {
-    the_output->AddToString(context->GetArgument(kArgOne)->text_);
+    the_output->AddToString(context->GetArgument(kArgOne)->text());
   }
 };
 
@@ -622,6 +753,42 @@ class LtFunction {
   }
 };
 
+// MatchFunction -- Function object for built-in function
+class MatchFunction {
+ public:
+  MatchFunction();
+  virtual ~MatchFunction();
+
+  static void evaluate(Context* context, Text* &the_output) {
+    Text* t = context->EvaluateArgument(kArgOne, the_output);
+    Text* pattern = context->EvaluateArgument(kArgTwo, the_output);
+    const char* error = NULL;
+    Regex* regex = Regex::Find(pattern ? pattern->string_ : "",
+                               pattern ? pattern->length_ : 0, &error);
+    if (regex == NULL) {
+        context->ReportErrorAndDie(error, pattern);
+    }
+    number group = 0;
+    if (context->argument_count() > kArgThree) {
+        group = context->EvaluateNumber(kArgThree, the_output);
+        if (group < 0 || group > regex->group_count()) {
+            context->ReportErrorAndDie("Bad group",
+                                       context->EvaluateArgument(kArgThree,
+                                                                 the_output));
+        }
+    }
+
+    // the match is made in the argument itself, without a copy
+    const char* s = t ? t->string_ : "";
+    int length = t ? t->length_ : 0;
+    std::vector<int> captures(2 * (regex->group_count() + 1));
+    if (regex->Match(s, length, 0, &captures[0]) && captures[group * 2] >= 0) {
+        the_output->AddToString(s + captures[group * 2],
+                                captures[group * 2 + 1] - captures[group * 2]);
+    }
+  }
+};
+
 // ModFunction -- Function object for built-in function
 class ModFunction: public ArithmeticFunction  {
  public:
@@ -651,10 +818,8 @@ class MuteFunction {
   virtual ~MuteFunction();
 
   static void evaluate(Context* context, Text* &the_output) {
-    Node* n = context->first_->next_;
-    while (n) {
-        context->EvaluateArgument(n, the_output);
-        n = n->next_;
+    for (int i = kArgOne; i < context->argument_count(); i += 1) {
+        context->EvaluateArgument(i, the_output);
     }
   }
 };
@@ -688,7 +853,7 @@ class NumberFunction {
 
   static void evaluate(Context* context, Text* &the_output) {
     number num = context->EvaluateArgument(kArgOne, the_output)->getNumber();
-    the_output->AddToString(context->EvaluateArgument(num != kNAN ? 2 : 3, the_output));
+    context->EvaluateInTail(num != kNAN ? 2 : 3, the_output);
   }
 };
 
@@ -699,14 +864,12 @@ class OrFunction {
   virtual ~OrFunction();
 
   static void evaluate(Context* context, Text* &the_output) {
-    Node* n = context->first_->next_;
     Text* t = NULL;
-    while (n) {
-        t = context->EvaluateArgument(n, the_output);
+    for (int i = kArgOne; i < context->argument_count(); i += 1) {
+        t = context->EvaluateArgument(i, the_output);
         if (t->length_) {
             break;
         }
-        n = n->next_;
     }
     the_output->AddToString(t);
   }
@@ -730,13 +893,132 @@ class ReadFunction {
   virtual ~ReadFunction();
 
   static void evaluate(Context* context, Text* &the_output) {
-    Text* string = new Text();
     Text* name = context->EvaluateArgument(kArgOne, the_output);
-    if (!string->ReadFromFile(name)) {
+    // an empty offset or length is the same as none
+    bool has_offset = IsGiven(context, kArgTwo, the_output);
+    bool has_length = IsGiven(context, kArgThree, the_output);
+    if (has_offset || has_length) {
+        // a slice is read by itself, without the rest of the file
+        number offset = 0;
+        number length = -1;
+        if (has_offset) {
+            offset = context->EvaluateNumber(kArgTwo, the_output);
+        }
+        if (offset < 0) {
+            context->ReportErrorAndDie("Bad offset",
+                                       context->EvaluateArgument(kArgTwo,
+                                                                 the_output));
+        }
+        if (has_length) {
+            length = context->EvaluateNumber(kArgThree, the_output);
+            if (length < 0) {
+                context->ReportErrorAndDie("Bad length",
+                    context->EvaluateArgument(kArgThree, the_output));
+            }
+        }
+        FileWriter::instance()->Wait(name);
+        if (!the_output->AddFromFile(name, offset, length)) {
+            context->ReportErrorAndDie("Error in reading file", name);
+        }
+        return;
+    }
+    CachedFile* file = FileCache::Find(name);
+    if (file == NULL) {
         context->ReportErrorAndDie("Error in reading file", name);
     }
-    the_output->AddToString(string);
-    delete string;
+    OutputBuffer::instance()->AddFile(the_output, file);
+    file->Release();
+  }
+
+ private:
+  // IsGiven
+  // Tests to determine if an argument is present and not empty
+  static bool IsGiven(Context* context, int argNr, Text* &the_output) {
+    if (context->argument_count() <= argNr) {
+        return false;
+    }
+    Text* t = context->EvaluateArgument(argNr, the_output);
+    return t != NULL && t->length_ > 0;
+  }
+};
+
+// RegexReplaceFunction -- Function object for built-in function
+class RegexReplaceFunction {
+ public:
+  RegexReplaceFunction();
+  virtual ~RegexReplaceFunction();
+
+  static void evaluate(Context* context, Text* &the_output) {
+    Text* t = context->EvaluateArgument(kArgOne, the_output);
+    Text* pattern = context->EvaluateArgument(kArgTwo, the_output);
+    Text* replacement = context->EvaluateArgument(kArgThree, the_output);
+    const char* error = NULL;
+    Regex* regex = Regex::Find(pattern ? pattern->string_ : "",
+                               pattern ? pattern->length_ : 0, &error);
+    if (regex == NULL) {
+        context->ReportErrorAndDie(error, pattern);
+    }
+    const char* s = t ? t->string_ : "";
+    int length = t ? t->length_ : 0;
+    the_output->Reserve(length);
+
+    // after an empty match the search moves on a character, so that it
+    // does not match in the same place again
+    std::vector<int> captures(2 * (regex->group_count() + 1));
+    int i = 0;
+    int from = 0;
+    while (from <= length && regex->Match(s, length, from, &captures[0])) {
+        the_output->AddToString(s + i, captures[0] - i);
+        if (replacement) {
+            AddReplacement(context, replacement, s, &captures[0],
+                           regex->group_count(), the_output);
+        }
+        i = captures[1];
+        from = captures[1];
+        if (captures[0] == captures[1]) {
+            if (from == length) {
+                break;
+            }
+            from = ByteScan::NextCharacter(s, length, from);
+        }
+    }
+    the_output->AddToString(s + i, length - i);
+  }
+
+ private:
+  // AddReplacement
+  // Add the replacement for a match, where \0 to \9 stand for the match
+  // and its groups, and \\ for a backslash
+  static void AddReplacement(Context* context, Text* replacement,
+                             const char* s, const int* captures, int groups,
+                             Text* &the_output) {
+    const char* r = replacement->string_;
+    int length = replacement->length_;
+    int i = 0;
+    for (int k = 0; k + 1 < length; k += 1) {
+        if (r[k] != '\\') {
+            continue;
+        }
+        int c = r[k + 1];
+        if (c == '\\') {
+            the_output->AddToString(r + i, k + 1 - i);
+        } else if (c >= '0' && c <= '9') {
+            if (c - '0' > groups) {
+                context->ReportErrorAndDie("Bad group", replacement);
+            }
+            the_output->AddToString(r + i, k - i);
+            int g = (c - '0') * 2;
+            if (captures[g] >= 0) {
+                the_output->AddToString(s + captures[g],
+                                        captures[g + 1] - captures[g]);
+            }
+        } else {
+            continue;
+        }
+        k += 1;
+        i = k + 1;
+    }
+    the_output->AddToString(r + i, length - i);
   }
 };
 
@@ -755,6 +1037,58 @@ class RepFunction {
   }
 };
 
+// ReplaceFunction -- Function object for built-in function
+class ReplaceFunction {
+ public:
+  ReplaceFunction();
+  virtual ~ReplaceFunction();
+
+  static void evaluate(Context* context, Text* &the_output) {
+    int count = context->argument_count();
+    Text* t = context->EvaluateArgument(kArgOne, the_output);
+    if (count <= kArgOne || t == NULL) {
+        context->ReportErrorAndDie("Too few parameters");
+    }
+    std::vector<Text*> pairs;   // each needle and its replacement
+    SubstringSearch needles;
+    for (int i = kArgTwo; i < count; i += 2) {
+        Text* needle = context->EvaluateArgument(i, the_output);
+        needles.AddNeedle(needle->string_, needle->length_);
+        pairs.push_back(needle);
+        pairs.push_back(i + 1 < count
+                        ? context->EvaluateArgument(i + 1, the_output) : NULL);
+    }
+
+    // find every match first, so that the result is allocated once
+    std::vector<int> matches;   // the index and needle of each match
+    int size = t->length_;
+    int which;
+    for (int i = 0;;) {
+        int r = needles.FindFirst(t->string_ + i, t->length_ - i, &which);
+        if (r < 0) {
+            break;
+        }
+        i += r;
+        matches.push_back(i);
+        matches.push_back(which);
+        Text* replacement = pairs[which * 2 + 1];
+        size += (replacement ? replacement->length_ : 0) -
+                pairs[which * 2]->length_;
+        i += pairs[which * 2]->length_;
+    }
+    the_output->Reserve(size);
+
+    int i = 0;
+    for (size_t m = 0; m < matches.size(); m += 2) {
+        which = matches[m + 1];
+        the_output->AddToString(t->string_ + i, matches[m] - i);
+        the_output->AddToString(pairs[which * 2 + 1]);
+        i = matches[m] + pairs[which * 2]->length_;
+    }
+    the_output->AddToString(t->string_ + i, t->length_ - i);
+  }
+};
+
 // SetFunction -- Function object for built-in function
 class SetFunction {
  public:
@@ -779,20 +1113,70 @@ class SlashifyFunction {
 
   static void evaluate(Context* context, Text* &the_output) {
     Text* t = context->EvaluateArgument(kArgOne, the_output);
-    int c;
-    int i;
     if (t && t->length_) {
-        for (i = 0; i < t->length_; i += 1) {
-            c = t->GetCharacter(i);
-            switch (c) {
-                case '\\':  // backslash
-                case '\'':  // single quote
-                case  '"':  // double quote
-                    the_output->AddToString('\\');
-                    break;
-            }
-            the_output->AddToString(c);
+        Transform::Slashify().Apply(t->string_, t->length_, the_output);
+    }
+  }
+};
+
+// SortFunction -- Function object for built-in function
+class SortFunction {
+ public:
+  SortFunction();
+  virtual ~SortFunction();
+
+  static void evaluate(Context* context, Text* &the_output) {
+    Text* list = context->EvaluateArgument(kArgOne, the_output);
+    Text* delimiter = context->EvaluateArgument(kArgTwo, the_output);
+    Text reverse_option("reverse");
+    Text unique_option("unique");
+    bool reverse = false;
+    bool unique = false;
+    for (int i = kArgThree; i < context->argument_count(); i += 1) {
+        Text* option = context->EvaluateArgument(i, the_output);
+        if (option->IsEqual(&reverse_option)) {
+            reverse = true;
+        } else if (option->IsEqual(&unique_option)) {
+            unique = true;
+        } else {
+            context->ReportErrorAndDie("Bad option", option);
+        }
+    }
+    if (list == NULL || list->length_ == 0) {
+        return;
+    }
+
+    // split as foreach does, but keep a trailing delimiter at the end
+    ListSort items;
+    SubstringSearch search;
+    int which;
+    int i = 0;
+    bool trailing = false;
+    if (delimiter) {
+        search.AddNeedle(delimiter->string_, delimiter->length_);
+    }
+    while (i < list->length_) {
+        int r = search.FindFirst(list->string_ + i, list->length_ - i,
+                                 &which);
+        int length = r < 0 ? list->length_ - i : r;
+        items.Add(list->string_ + i, length);
+        i += length;
+        if (r >= 0) {
+            i += delimiter->length_;
+            trailing = i == list->length_;
+        }
+    }
+
+    items.Sort(reverse, unique);
+    the_output->Reserve(list->length_);
+    for (int n = 0; n < items.count(); n += 1) {
+        if (n > 0) {
+            the_output->AddToString(delimiter);
         }
+        the_output->AddToString(items.item(n), items.length(n));
+    }
+    if (trailing) {
+        the_output->AddToString(delimiter);
     }
   }
 };
@@ -826,24 +1210,24 @@ class SubstrFunction {
   virtual ~SubstrFunction();
 
   static void evaluate(Context* context, Text* &the_output) {
-    Node* arg = context->first_->next_;
-    Text* string = context->EvaluateArgument(arg, the_output);
-    arg = arg->next_;
-    if (arg) {
-      number start = context->EvaluateNumber(arg, the_output);
+    int count = context->argument_count();
+    Text* string = context->EvaluateArgument(context->argument(kArgOne),
+                                             the_output);
+    if (count > kArgTwo) {
+      number start = context->EvaluateNumber(kArgTwo, the_output);
       if (start < 0) {
         start += string->length_;
       }
       number len = kInfinity;
-      arg = arg->next_;
-      if (arg) {
-        len = context->EvaluateNumber(arg, the_output);
+      if (count > kArgThree) {
+        len = context->EvaluateNumber(kArgThree, the_output);
       }
       if (start >= 0 && len > 0) {
-        the_output->AddToString(
-            context->EvaluateArgument(kArgOne, the_output)->utfSubstr(
-                static_cast<int>(start),
-                static_cast<int>(len)));
+        Text* sub = context->EvaluateArgument(kArgOne, the_output)->utfSubstr(
+            static_cast<int>(start),
+            static_cast<int>(len));
+        the_output->AddToString(sub);
+        delete sub;
       }
     }
   }
@@ -856,10 +1240,8 @@ class TrimFunction {
   virtual ~TrimFunction();
 
   static void evaluate(Context* context, Text* &the_output) {
-    Node* n = context->first_->next_;
-    while (n) {
-        the_output->RemoveSpacesAddToString(context->EvaluateArgument(n, the_output));
-        n = n->next_;
+    for (int i = kArgOne; i < context->argument_count(); i += 1) {
+        the_output->RemoveSpacesAddToString(context->EvaluateArgument(i, the_output));
     }
   }
 };
@@ -871,8 +1253,7 @@ class UnicodeFunction {
   virtual ~UnicodeFunction();
 
   static void evaluate(Context* context, Text* &the_output) {
-    Node* n = context->first_->next_;
-    while (n) {
+    for (int n = kArgOne; n < context->argument_count(); n += 1) {
         number num = context->EvaluateNumber(n, the_output);
         if (num >= 0) {
             int i = static_cast<int>(num);
@@ -896,7 +1277,20 @@ class UnicodeFunction {
                 "Bad character code", context->EvaluateArgument(n, the_output));
             return;
         }
-        n = n->next_;
+    }
+  }
+};
+
+// UrlencodeFunction -- Function object for built-in function
+class UrlencodeFunction {
+ public:
+  UrlencodeFunction();
+  virtual ~UrlencodeFunction();
+
+  static void evaluate(Context* context, Text* &the_output) {
+    Text* t = context->EvaluateArgument(kArgOne, the_output);
+    if (t && t->length_) {
+        Transform::UrlEncode().Apply(t->string_, t->length_, the_output);
     }
   }
 };
@@ -909,9 +1303,15 @@ class WriteFunction {
 
   static void evaluate(Context* context, Text* &the_output) {
     Text* name = context->EvaluateArgument(kArgOne, the_output);
-    if (!context->EvaluateArgument(kArgTwo, the_output)->WriteToFile(name)) {
-      context->ReportErrorAndDie("Error in writing file", name);
-    }
+    Text* value = context->EvaluateArgument(kArgTwo, the_output);
+    // the output, or a program still running, may be reading the file
+    // from its mapping
+    OutputBuffer::instance()->CopyOut(name);
+    FileCache::CopyOut(name);
+    // the file is written on another thread; an error in writing it is
+    // reported when the writes are flushed
+    FileWriter::instance()->Write(name, value->string_, value->length_);
+    FileCache::Changed(name);
   }
 };
 #endif  // SRC_FUNCTION_H_
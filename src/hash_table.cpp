@@ -4,91 +4,223 @@
 
 #include "hash_table.h"
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "tilton.h"
 #include "text.h"
 #include "macro.h"
+#include "symbol.h"
 
 HashTable::HashTable() {
-    int i;
+    slots_ = new Slot[kInitialSize];
+    memset(slots_, 0, kInitialSize * sizeof(Slot));
+    mask_ = kInitialSize - 1;
+    count_ = 0;
+    first_ = last_ = NULL;
+}
 
-    for (i = kMaxHash; i >= 0; i -= 1) {
-        the_macro_list_[i] = NULL;
-    }
+HashTable::~HashTable() {
+    delete[] slots_;
 }
 
-HashTable::~HashTable() {}
+HashTable::Slot* HashTable::Find(Text* name, uint32 hash) {
+    int i = static_cast<int>(hash & mask_);
+    for (;;) {
+        Slot* slot = &slots_[i];
+        if (slot->symbol == NULL ||
+            (slot->hash == hash && slot->symbol->IsNameEqual(name))) {
+            return slot;
+        }
+        i = (i + 1) & mask_;
+    }
+}
 
-Macro* HashTable::the_macro_list(uint32 h) const {
-    return the_macro_list_[h];
+void HashTable::Grow() {
+    Slot* old = slots_;
+    int old_size = mask_ + 1;
+    int size = old_size * 2;
+    slots_ = new Slot[size];
+    memset(slots_, 0, size * sizeof(Slot));
+    mask_ = size - 1;
+    for (int j = 0; j < old_size; j += 1) {
+        if (old[j].symbol) {
+            int i = static_cast<int>(old[j].hash & mask_);
+            while (slots_[i].symbol) {
+                i = (i + 1) & mask_;
+            }
+            slots_[i] = old[j];
+        }
+    }
+    delete[] old;
 }
 
-void HashTable::set_the_macro_list(uint32 h, Macro* m) {
-    the_macro_list_[h] = m;
+Symbol* HashTable::LookupSymbol(Text* name) {
+    return Find(name, name->Hash())->symbol;
 }
 
-void HashTable::InsertIntoHashTable(Text* name, Macro* m) {
-    uint32 h = name->Hash() & kMaxHash;
-    m->set_name(name);
-    m->link_ = HashTable::the_macro_list(h);
-    HashTable::set_the_macro_list(h, m);
+Symbol* HashTable::LookupSymbol(const char* s, int len) {
+    Text name(s, len, true);
+    return LookupSymbol(&name);
 }
 
-void HashTable::InstallMacro(const char* namestring, const char* string) {
-    Text* name = new Text(namestring);
-    HashTable::InsertIntoHashTable(name, new Macro(string));
-    delete name;
+Symbol* HashTable::Intern(Text* name) {
+    uint32 h = name->Hash();
+    Slot* slot = Find(name, h);
+    if (slot->symbol) {
+        return slot->symbol;
+    }
+
+    // keep the table under three quarters full, and keep probes short
+    int probe = static_cast<int>((slot - slots_ - h) & mask_);
+    if ((count_ + 1) * 4 > (mask_ + 1) * 3 || probe > kMaxProbe) {
+        Grow();
+        slot = Find(name, h);
+    }
+
+    Symbol* s = new Symbol(name, h);
+    slot->hash = h;
+    slot->symbol = s;
+    count_ += 1;
+    s->prior_ = last_;
+    if (last_) {
+        last_->link_ = s;
+    } else {
+        first_ = s;
+    }
+    last_ = s;
+    return s;
 }
 
-Macro* HashTable::LookupMacro(Text* name) {
-    Macro* m = HashTable::the_macro_list(name->Hash() & kMaxHash);
-    while (m) {
-        if (m->IsNameEqual(name)) {
+void HashTable::Remove(Symbol* symbol) {
+    int i = static_cast<int>(symbol->hash_ & mask_);
+    while (slots_[i].symbol != symbol) {
+        i = (i + 1) & mask_;
+    }
+
+    // shift back each symbol after the hole that may not be found past it
+    int j = i;
+    for (;;) {
+        j = (j + 1) & mask_;
+        if (slots_[j].symbol == NULL) {
             break;
         }
-        m = m->link_;
+        int home = static_cast<int>(slots_[j].hash & mask_);
+        if (((j - home) & mask_) >= ((j - i) & mask_)) {
+            slots_[i] = slots_[j];
+            i = j;
+        }
+    }
+    slots_[i].hash = 0;
+    slots_[i].symbol = NULL;
+    count_ -= 1;
+
+    if (symbol->prior_) {
+        symbol->prior_->link_ = symbol->link_;
+    } else {
+        first_ = symbol->link_;
+    }
+    if (symbol->link_) {
+        symbol->link_->prior_ = symbol->prior_;
+    } else {
+        last_ = symbol->prior_;
+    }
+    delete symbol;
+}
+
+void HashTable::Retain(Symbol* symbol) {
+    symbol->references_ += 1;
+}
+
+void HashTable::Release(Symbol* symbol) {
+    symbol->references_ -= 1;
+    if (symbol->references_ == 0 && !symbol->builtin_ && !symbol->macro_) {
+        Remove(symbol);
     }
+}
+
+Symbol* HashTable::Intern(const char* s, int len) {
+    Text name(s, len, true);
+    return Intern(&name);
+}
+
+Macro* HashTable::NewMacro(Symbol* symbol, Text* value) {
+    Macro* m = new Macro(value);
+    m->set_name(symbol->name_, symbol->name_length_);
+    symbol->macro_ = m;
     return m;
 }
 
+void HashTable::InstallMacro(const char* namestring, const char* string) {
+    Text name(namestring);
+    Text value(string);
+    InstallMacro(&name, &value);
+}
+
+Macro* HashTable::LookupMacro(Text* name) {
+    Symbol* s = LookupSymbol(name);
+    return s ? s->macro_ : NULL;
+}
+
 void HashTable::InstallMacro(Text* name, Text* value) {
-    Macro* m = HashTable::LookupMacro(name);
-    if (m) {
-        m->set_string(value);
+    Symbol* s = Intern(name);
+    if (s->macro_) {
+        s->macro_->set_string(value);
     } else {
-        HashTable::InsertIntoHashTable(name, new Macro(value));
+        NewMacro(s, value);
     }
 }
 
-void HashTable::InstallMacro(Text* name, Macro* value) {
-  Macro* m = HashTable::LookupMacro(name);
-  if (m) {
-    m->set_string(new Text(value));
-  } else {
-    HashTable::InsertIntoHashTable(name, value);
-  }
+void HashTable::InstallBuiltin(const char* namestring, Builtin function) {
+    Intern(namestring, static_cast<int>(strlen(namestring)))->builtin_ =
+        function;
+}
+
+void HashTable::DeleteMacro(Text* name) {
+    Symbol* s = LookupSymbol(name);
+    if (s && s->macro_) {
+        // the program of the macro may hold the symbol too, so keep it
+        // until the macro is gone
+        Macro* m = s->macro_;
+        s->macro_ = NULL;
+        Retain(s);
+        delete m;
+        Release(s);
+    }
 }
 
 void HashTable::PrintMacroTable() {
-    int i;
-    for (i = 0; i < (kMaxHash + 1); i += 1) {
-        Macro* macro = HashTable::the_macro_list(i);
-        if (macro) {
-            macro->PrintMacroList();
+    for (Symbol* s = first_; s; s = s->link_) {
+        if (s->macro_) {
+            s->macro_->PrintMacro();
         }
     }
 }
 
 Macro* HashTable::GetMacroDefOrInsertNull(Text* name) {
-    Macro* t = HashTable::LookupMacro(name);
-    if (!t) {
-        t = new Macro(0);
-        uint32 h = name->Hash() & kMaxHash;
-        t->set_name(name);
-        t->link_ = HashTable::the_macro_list(h);
-        HashTable::set_the_macro_list(h, t);
+    Symbol* s = Intern(name);
+    if (!s->macro_) {
+        NewMacro(s, NULL);
     }
-    return t;
+    return s->macro_;
 }
 
+void HashTable::PrintStatistics() {
+    int size = mask_ + 1;
+    int longest = 0;
+    double total = 0;
+    for (int i = 0; i < size; i += 1) {
+        if (slots_[i].symbol) {
+            int probe = static_cast<int>((i - slots_[i].hash) & mask_);
+            total += probe + 1;
+            if (probe + 1 > longest) {
+                longest = probe + 1;
+            }
+        }
+    }
+    fprintf(stderr, "symbols %d, slots %d, load %.2f, "
+            "mean probe %.2f, longest probe %d\n",
+            count_, size, static_cast<double>(count_) / size,
+            count_ ? total / count_ : 0.0, longest);
+}
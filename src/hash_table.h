@@ -8,20 +8,38 @@
 #include "tilton.h"
 
 class Macro;
+class Symbol;
 
-// kMaxHash is the largest index in the hash table. It must be (2**n)-1.
-const int kMaxHash = 1023;
+// HashTable -- responsible for managing a hash table of symbols
+//  Builtins and macros share one table of interned Symbols, so finding what
+//  a name means is a single probe.
 
-// HashTable -- responsible for managing a hash table of macros
+//  The table is open addressed with linear probing. Each slot keeps the
+//  hash of its symbol beside the pointer, so a probe compares names only
+//  when the hashes match. The table doubles when it is three quarters full,
+//  or when an insertion has to probe further than kMaxProbe slots. A
+//  symbol that no longer means anything and that no program holds is
+//  removed by shifting the slots after it back, so there are no tombstones;
+//  see Program::Keep for how names that are seen once stay out of the
+//  table.
 
 class HashTable {
  public:
   HashTable();
   virtual ~HashTable();
 
+  // Intern
+  //  Return the symbol for a name, making it if the name is new.
+  Symbol* Intern(Text* name);
+  Symbol* Intern(const char* s, int len);
+
+  // LookupSymbol
+  //  Return the symbol for a name, or NULL if it has never been interned.
+  Symbol* LookupSymbol(Text* name);
+  Symbol* LookupSymbol(const char* s, int len);
+
   // LookupMacro
-  //  Search through the macro list for a text with a specific name.
-  //  The list is a hash table with links for collisions.
+  //  Search the table for the macro with a specific name.
   Macro* LookupMacro(Text* name);
 
   // InstallMacro
@@ -29,23 +47,64 @@ class HashTable {
   //  value. Otherwise, make a new text with this name and value and put
   //  it in the list.
   void  InstallMacro(Text* name, Text* value);
-  void  InstallMacro(Text* name, Macro* value);
-  //  This is a little faster than InstallMacro() because it assumes that
-  //  the name is not already in the macro list.
   void  InstallMacro(const char* namestring, const char* string);
 
+  // InstallBuiltin
+  //  Make name call a built-in function
+  void  InstallBuiltin(const char* namestring, Builtin function);
+
+  // DeleteMacro
+  //  Remove the macro with this name, if there is one
+  void  DeleteMacro(Text* name);
+
+  // Retain
+  //  Take a reference to a symbol for a compiled call
+  void  Retain(Symbol* symbol);
+
+  // Release
+  //  Drop a reference to a symbol, freeing it if nothing else keeps it
+  void  Release(Symbol* symbol);
+
+  // PrintMacroTable
+  //  Write the macros to stderr in the order their symbols were made
   void  PrintMacroTable();
 
   Macro* GetMacroDefOrInsertNull(Text* name);
 
+  // PrintStatistics
+  //  Write the size, load and probe lengths of the table to stderr
+  void  PrintStatistics();
 
  private:
-  Macro* the_macro_list_[kMaxHash + 1];
+  struct Slot {
+    uint32   hash;
+    Symbol*  symbol;    // NULL if the slot is empty
+  };
 
-  Macro* the_macro_list(uint32 h) const;
-  void  set_the_macro_list(uint32 h, Macro* m);
-  void  InsertIntoHashTable(Text* name, Macro* m);
+  static const int kInitialSize = 1024;
+  static const int kMaxProbe = 32;
+
+  // Find
+  //  Return the slot holding name, or the empty slot where it belongs
+  Slot*  Find(Text* name, uint32 hash);
+
+  // Grow
+  //  Double the number of slots and reinsert every symbol
+  void   Grow();
+
+  // Remove
+  //  Take a symbol out of the slots and the order, and free it
+  void   Remove(Symbol* symbol);
+
+  // NewMacro
+  //  Give a symbol a macro
+  Macro* NewMacro(Symbol* symbol, Text* value);
+
+  Slot*    slots_;
+  int      mask_;       // the number of slots less one, a power of 2 less 1
+  int      count_;      // the number of symbols
+  Symbol*  first_;      // all symbols in the order interned
+  Symbol*  last_;
 };
 
 #endif  // SRC_HASH_TABLE_H_
-
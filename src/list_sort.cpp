@@ -0,0 +1,174 @@
+// Copyright (c) 2011 Revelux Labs, LLC. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+#include "list_sort.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "text.h"
+
+typedef ListSort::Item Item;
+
+static bool Less(const Item& a, const Item& b) {
+  if (a.group != b.group) {
+    return a.group < b.group;
+  }
+  if (a.group == ListSort::kNumber) {
+    return a.value < b.value;
+  }
+  return Text::ltStr(a.string, a.length, b.string, b.length);
+}
+
+// ItemLess -- the order of a sort, or its reverse.
+struct ItemLess {
+  bool reverse;
+
+  bool operator()(const Item& a, const Item& b) const {
+    return reverse ? Less(b, a) : Less(a, b);
+  }
+};
+
+// SortJob -- a piece of the list for one thread to sort, or two sorted
+//  neighbors, begin to middle and middle to end, for it to merge.
+struct SortJob {
+  Item*           begin;
+  Item*           middle;
+  Item*           end;
+  const ItemLess* less;
+};
+
+static void* SortPiece(void* p) {
+  SortJob* job = static_cast<SortJob*>(p);
+  std::stable_sort(job->begin, job->end, *job->less);
+  return NULL;
+}
+
+static void* MergePieces(void* p) {
+  SortJob* job = static_cast<SortJob*>(p);
+  std::inplace_merge(job->begin, job->middle, job->end, *job->less);
+  return NULL;
+}
+
+// Run every job, the first on this thread and the others on threads of
+// their own. A job whose thread cannot be started is run here instead.
+static void RunJobs(std::vector<SortJob>* jobs, void* (*work)(void*)) {
+  int count = static_cast<int>(jobs->size());
+  std::vector<pthread_t> threads(count);
+  std::vector<bool> started(count, false);
+  for (int j = 1; j < count; j += 1) {
+    started[j] = pthread_create(&threads[j], NULL, work, &(*jobs)[j]) == 0;
+  }
+  work(&(*jobs)[0]);
+  for (int j = 1; j < count; j += 1) {
+    if (started[j]) {
+      pthread_join(threads[j], NULL);
+    } else {
+      work(&(*jobs)[j]);
+    }
+  }
+}
+
+ListSort::ListSort() {
+}
+
+ListSort::~ListSort() {
+}
+
+void ListSort::Add(const char* s, int len) {
+  Item item;
+  item.string = s;
+  item.length = len;
+  item.value = 0;
+  if (Text::allDigits(s, len)) {
+    item.group = kNumber;
+    item.value = Text::digitValue(s, len);
+  } else if (Text::ltStr(s, len, "0", 1)) {
+    item.group = kBeforeNumbers;
+  } else {
+    item.group = kAfterNumbers;
+  }
+  items_.push_back(item);
+}
+
+// The first of the items that are the same is kept, in an open addressed
+// table of the items kept so far.
+void ListSort::RemoveDuplicates() {
+  int count = static_cast<int>(items_.size());
+  int size = 16;
+  while (size < count * 2) {
+    size *= 2;
+  }
+  std::vector<int> slots(size, -1);
+  int kept = 0;
+  for (int i = 0; i < count; i += 1) {
+    const Item& item = items_[i];
+    int h = static_cast<int>(Text::Hash(item.string, item.length) &
+                             (size - 1));
+    bool duplicate = false;
+    while (slots[h] >= 0) {
+      const Item& other = items_[slots[h]];
+      if (other.length == item.length &&
+          memcmp(other.string, item.string, item.length) == 0) {
+        duplicate = true;
+        break;
+      }
+      h = (h + 1) & (size - 1);
+    }
+    if (!duplicate) {
+      items_[kept] = item;
+      slots[h] = kept;
+      kept += 1;
+    }
+  }
+  items_.resize(kept);
+}
+
+void ListSort::Sort(bool reverse, bool unique) {
+  if (unique) {
+    RemoveDuplicates();
+  }
+  ItemLess less = { reverse };
+  int count = static_cast<int>(items_.size());
+  int threads = static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));
+  if (threads > kMaxThreads) {
+    threads = kMaxThreads;
+  }
+  if (count < kParallelThreshold || threads < 2) {
+    std::stable_sort(items_.begin(), items_.end(), less);
+    return;
+  }
+
+  // sort a piece on each thread, then merge neighbors until one is left
+  Item* items = &items_[0];
+  std::vector<int> bounds;
+  for (int t = 0; t <= threads; t += 1) {
+    bounds.push_back(static_cast<int>(static_cast<long>(count) * t / threads));
+  }
+  std::vector<SortJob> jobs;
+  for (int t = 0; t < threads; t += 1) {
+    SortJob job = { items + bounds[t], NULL, items + bounds[t + 1], &less };
+    jobs.push_back(job);
+  }
+  RunJobs(&jobs, SortPiece);
+  while (bounds.size() > 2) {
+    std::vector<int> merged;
+    jobs.clear();
+    size_t b = 0;
+    for (; b + 2 < bounds.size(); b += 2) {
+      SortJob job = { items + bounds[b], items + bounds[b + 1],
+                      items + bounds[b + 2], &less };
+      jobs.push_back(job);
+      merged.push_back(bounds[b]);
+    }
+    for (; b < bounds.size(); b += 1) {
+      merged.push_back(bounds[b]);
+    }
+    RunJobs(&jobs, MergePieces);
+    bounds.swap(merged);
+  }
+}
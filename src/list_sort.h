@@ -0,0 +1,78 @@
+// Copyright (c) 2011 Revelux Labs, LLC. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+#ifndef SRC_LIST_SORT_H_
+#define SRC_LIST_SORT_H_
+
+#include <vector>
+
+#include "tilton.h"
+
+// ListSort -- sorts the items of a list as lt? orders them.
+//  Two items that are both all digits are compared as numbers, and any
+//  other two byte by byte, as Text::lt does. Whether an item is all digits
+//  and its value are worked out once when it is added, so a comparison
+//  does not rescan it.
+
+//  lt? is not consistent on a list that mixes numbers and other items: 2
+//  is before 10 as numbers, 10 before 1a and 1a before 2 as strings. So a
+//  number and another item are not compared byte by byte; the numbers go
+//  together, after the items that are before "0" and before all the rest.
+//  That makes the order total, and the result of the sort the same however
+//  the list is cut up.
+
+//  The order is a merge sort, which keeps items that compare alike in
+//  their original order. A long list is cut into pieces that are sorted,
+//  and then merged, on several threads.
+
+//  The items are not copied, so they must outlive the sort.
+
+class ListSort {
+ public:
+  ListSort();
+  virtual ~ListSort();
+
+  // Add
+  // Add an item to the end of the list
+  void    Add(const char* s, int len);
+
+  // Sort
+  // Put the items in order, or in the reverse order. Unique drops every
+  // item that is the same, byte for byte, as one that is kept.
+  void    Sort(bool reverse, bool unique);
+
+  // count
+  // The number of items
+  int     count() const { return static_cast<int>(items_.size()); }
+
+  // item, length
+  // The characters and length of item i
+  const char* item(int i) const { return items_[i].string; }
+  int     length(int i) const { return items_[i].length; }
+
+  // the groups of items, in order
+  static const int kBeforeNumbers = 0;
+  static const int kNumber = 1;         // every byte is a digit
+  static const int kAfterNumbers = 2;
+
+  // Item -- a view of an item with what lt needs to know about it
+  struct Item {
+    const char* string;
+    int         length;
+    int         group;    // kBeforeNumbers, kNumber or kAfterNumbers
+    number      value;    // the value of a number
+  };
+
+ private:
+  // RemoveDuplicates
+  // Drop every item that is the same as an earlier one
+  void    RemoveDuplicates();
+
+  static const int kParallelThreshold = 16384;
+  static const int kMaxThreads = 8;
+
+  std::vector<Item> items_;
+};
+
+#endif  // SRC_LIST_SORT_H_
@@ -9,6 +9,8 @@
 #include <stdlib.h>
 
 #include "tilton.h"
+#include "program.h"
+#include "substring_search.h"
 
 Macro::Macro() {
     InitializeMacro(NULL, 0);
@@ -31,7 +33,8 @@ Macro::Macro(Text* t) {
 }
 
 Macro::~Macro() {
-    delete this->definition_;
+    ReleaseProgram();
+    delete this->storage_;
     delete this->name_;
 }
 
@@ -41,6 +44,7 @@ void Macro::AddToString(const char* s, int len) {
         memmove(&definition_[length_], s, len);
         length_ += len;
         my_hash_ = 0;
+        ReleaseProgram();
     }
 }
 
@@ -53,66 +57,57 @@ void Macro::AddToString(Text* t) {
 void Macro::CheckLengthAndIncrease(int len) {
     int newMaxLength;
     int req = length_ + len;
+    if (max_length_ < head_ + req) {
+        Compact();
+    }
     if (max_length_ < req) {
         newMaxLength = max_length_ * 2;
         if (newMaxLength < req) {
             newMaxLength = req;
         }
         char* newString = new char[newMaxLength];
-        memmove(newString, definition_, max_length_);
-        delete definition_;
-        definition_ = newString;
+        memmove(newString, definition_, length_);
+        delete storage_;
+        storage_ = definition_ = newString;
         max_length_ = newMaxLength;
     }
 }
 
-void Macro::PrintMacroList() {
-    Macro* t = this;
-    while (t) {
-        fwrite(t->name_, sizeof(char), t->name_length_, stderr);
-        if (t->length_) {
-            fputc('~', stderr);
-            fwrite(t->definition_, sizeof(char), t->length_, stderr);
-        }
-        fprintf(stderr, "\n");
-        t = t->link_;
+void Macro::Compact() {
+    if (head_) {
+        memmove(storage_, definition_, length_);
+        definition_ = storage_;
+        head_ = 0;
+    }
+}
+
+void Macro::PrintMacro() {
+    fwrite(name_, sizeof(char), name_length_, stderr);
+    if (length_) {
+        fputc('~', stderr);
+        fwrite(definition_, sizeof(char), length_, stderr);
     }
+    fprintf(stderr, "\n");
 }
 
 int Macro::FindFirstSubstring(Text *t) {
-  int len = t->length_;
-  char* s = t->string_;
-  if (len) {
-    bool b;
-    int d = length_ - len;
-    int i;
-    int r;
-    for (r = 0; r <= d; r += 1) {
-      b = true;
-      for (i = 0; i < len; i += 1) {
-        if (definition_[r + i] != s[i]) {
-          b = false;
-          break;
-        }
-      }
-      if (b) {
-        return r;
-      }
-    };
-  }
-  return -1;
+  SubstringSearch search;
+  int needle;
+  search.AddNeedle(t->string_, t->length_);
+  return search.FindFirst(definition_, length_, &needle);
 }
 
 void Macro::InitializeMacro(const char* s, int len) {
     name_ = NULL;
-    link_ = NULL;
+    program_ = NULL;
     length_ = name_length_ = 0;
     my_hash_ = 0;
     max_length_ = len;
+    head_ = 0;
     if (len == 0) {
-        definition_ = NULL;
+        storage_ = definition_ = NULL;
     } else {
-        definition_ = new char[len];
+        storage_ = definition_ = new char[len];
         if (s) {
             memmove(definition_, s, len);
             length_ = len;
@@ -133,34 +128,22 @@ bool Macro::IsNameEqual(Text* t) {
 }
 
 int Macro::FindLastSubstring(Text *t) {
-  int len = t->length_;
-  char* s = t->string_;
-  if (len) {
-    bool b;
-    int d = length_ - len;
-    for (int r = d; r >= 0; r -= 1) {
-      b = true;
-      for (int i = 0; i < len; i += 1) {
-        if (definition_[r + i] != s[i]) {
-          b = false;
-          break;
-        }
-      }
-      if (b) {
-        return r;
-      }
-    }
-  }
-  return -1;
+  SubstringSearch search;
+  int needle;
+  search.AddNeedle(t->string_, t->length_);
+  return search.FindLast(definition_, length_, &needle);
 }
 
 void Macro::set_string(Text* t) {
     my_hash_ = 0;
+    ReleaseProgram();
+    definition_ = storage_;
+    head_ = 0;
     if (t && t->length_) {
         length_ = t->length_;
         if (length_ > max_length_) {
-            delete definition_;
-            definition_ = new char[length_];
+            delete storage_;
+            storage_ = definition_ = new char[length_];
             max_length_ = length_;
         }
         memmove(definition_, t->string_, length_);
@@ -185,6 +168,30 @@ void Macro::set_name(Text* t) {
 }
 
 void Macro::ReplaceDefWithSubstring(int start, int len) {
-    memmove(definition_, &definition_[start], len);
+    definition_ += start;
+    head_ += start;
     length_ = len;
+    my_hash_ = 0;
+    if (length_ == 0) {
+        definition_ = storage_;
+        head_ = 0;
+    } else if (head_ > kCompactThreshold && head_ > length_) {
+        Compact();
+    }
+    ReleaseProgram();
+}
+
+Program* Macro::program() {
+    if (!program_) {
+        program_ = new Program(new Text(this), true);
+        program_->Keep();
+    }
+    return program_;
+}
+
+void Macro::ReleaseProgram() {
+    if (program_) {
+        program_->Release();
+        program_ = NULL;
+    }
 }
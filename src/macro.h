@@ -10,12 +10,18 @@
 #include "text.h"
 
 class Context;
+class Program;
 
 typedef void (*Builtin)(Context* context, Text* &the_output);
 
 // Macro -- represents the name and expansion text of a macro.
-//  A Macro can have a link which can chain Macros
-//  together. This is used to manage hash collisions.
+//  A Macro belongs to the Symbol of its name.
+
+//  definition_ points into an allocation that can have a consumed prefix,
+//  so that first can take a token off the front by moving a cursor. The
+//  live text is moved back to the front only once the prefix is both
+//  larger than a threshold and larger than the text, or when an append
+//  needs the room, which keeps repeated tokenizing linear.
 
 class Macro {
  public:
@@ -30,14 +36,9 @@ class Macro {
   void    AddToString(const char* s, int len);
   void    AddToString(Text* t);
   
-  // PrintMacroList
-  // write the macro list of stdout
-  void    PrintMacroList();
-  
-  // Hash
-  // calculate a hash for a string
-  // used to hash macro names
-  uint32  Hash();
+  // PrintMacro
+  // write the name and definition to stderr
+  void    PrintMacro();
   
   // FindFirstSubstring
   // returns the first match in the macro definition
@@ -61,15 +62,19 @@ class Macro {
   
   // ReplaceDefWithSubstring
   // replace the definition with a substring of the definition
+  // Taking from the front advances the cursor rather than moving the text
   void    ReplaceDefWithSubstring(int start, int len);
   
   // RemoveSpacesAddToString
   // trims whitespace before appending to definition_
   void    RemoveSpacesAddToString(Text* t);
+
+  // program
+  // The compiled definition, compiled when first needed
+  Program* program();
   
   char*        definition_;
   int          length_;
-  Macro*       link_;       // hash collisions
   char*        name_;
   int          name_length_;
 
@@ -80,13 +85,26 @@ class Macro {
   //  then increase the size of the string. The new allocation will be at least
   //  twice the previous allocation.
   void    CheckLengthAndIncrease(int len);
+
+  // Compact
+  // Move the definition to the front of its allocation
+  void    Compact();
   
   // InitializeMacro
   // initialize the macro object
   void    InitializeMacro(const char* s, int len);
 
+  // ReleaseProgram
+  // Drop the compiled definition after the definition changes
+  void    ReleaseProgram();
+
+  static const int kCompactThreshold = 4096;
+
+  char*   storage_;           // the allocation that definition_ points into
+  int     head_;              // the consumed prefix of storage_
   uint32  my_hash_;
-  int     max_length_;
+  int     max_length_;        // the size of storage_
+  Program* program_;
 };
 
 #endif  // SRC_MACRO_H_
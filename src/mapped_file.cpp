@@ -0,0 +1,71 @@
+// Copyright (c) 2011 Revelux Labs, LLC. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+#include "mapped_file.h"
+
+#include <limits.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile() {
+  base_ = NULL;
+  size_ = 0;
+  data_ = NULL;
+  length_ = 0;
+  detached_ = false;
+}
+
+MappedFile::~MappedFile() {
+  if (base_) {
+    munmap(base_, size_);
+  }
+}
+
+bool MappedFile::Map(int fd) {
+  struct stat st;
+  if (base_ || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    return false;
+  }
+  off_t offset = lseek(fd, 0, SEEK_CUR);
+  if (offset < 0 || offset >= st.st_size ||
+      st.st_size - offset > INT_MAX) {
+    // an empty remainder needs no mapping, but is read as usual
+    return false;
+  }
+  void* base = mmap(NULL, static_cast<size_t>(st.st_size), PROT_READ,
+                    MAP_PRIVATE, fd, 0);
+  if (base == MAP_FAILED) {
+    return false;
+  }
+  madvise(base, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+  lseek(fd, 0, SEEK_END);
+  base_ = base;
+  size_ = static_cast<size_t>(st.st_size);
+  data_ = static_cast<const char*>(base) + offset;
+  length_ = static_cast<int>(st.st_size - offset);
+  return true;
+}
+
+// The copy is made beside the mapping and then moved over it, so the bytes
+// are never missing from their address.
+void MappedFile::Detach() {
+  if (base_ == NULL || detached_) {
+    return;
+  }
+  void* copy = mmap(NULL, size_, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (copy == MAP_FAILED) {
+    return;
+  }
+  memmove(copy, base_, size_);
+  mprotect(copy, size_, PROT_READ);
+  if (mremap(copy, size_, size_, MREMAP_MAYMOVE | MREMAP_FIXED, base_) ==
+      MAP_FAILED) {
+    munmap(copy, size_);
+    return;
+  }
+  detached_ = true;
+}
@@ -0,0 +1,50 @@
+// Copyright (c) 2011 Revelux Labs, LLC. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+#ifndef SRC_MAPPED_FILE_H_
+#define SRC_MAPPED_FILE_H_
+
+#include <stddef.h>
+
+// MappedFile -- a regular file mapped read only into memory.
+//  A Text can borrow the bytes of a mapping instead of copying the file
+//  onto the heap, so a big input costs its pages in the page cache and
+//  nothing more. The mapping must outlive every Text that borrows it.
+
+//  Pipes, terminals and the like cannot be mapped, and neither can a file
+//  too long for a Text; Map refuses them and the caller reads them
+//  instead. A file that is cut short while it is mapped takes its
+//  readers down with it, as it would any program that maps it, so a
+//  mapping is detached from its file before the file is written over.
+
+class MappedFile {
+ public:
+  MappedFile();
+  virtual ~MappedFile();
+
+  // Map
+  // Map what is left of the file open on fd, from its current offset to
+  // its end, and move the offset to the end as reading it would. Returns
+  // false if the file cannot be mapped.
+  bool    Map(int fd);
+
+  // Detach
+  // Put a copy of the bytes in memory of its own, at the same address, so
+  // that they stay as they are whatever happens to the file
+  void    Detach();
+
+  // data, length
+  // The bytes of the file from the offset Map found
+  const char* data() const { return data_; }
+  int     length() const { return length_; }
+
+ private:
+  void*   base_;        // the start of the mapping
+  size_t  size_;        // the size of the mapping
+  const char* data_;
+  int     length_;
+  bool    detached_;    // the mapping no longer belongs to the file
+};
+
+#endif  // SRC_MAPPED_FILE_H_
@@ -7,23 +7,40 @@
 #include <stdio.h>
 
 Node::Node(Text* t) {
+    span_ = NULL;
+    span_length_ = 0;
     text_ = t;
     value_ = NULL;
-    next_ = NULL;
+}
+
+Node::Node(const char* s, int len) {
+    span_ = s;
+    span_length_ = len;
+    text_ = NULL;
+    value_ = NULL;
 }
 
 Node::~Node(void) {
     delete this->text_;
     delete this->value_;
-    delete this->next_;
+}
+
+Text* Node::text() {
+    if (text_ == NULL && span_ != NULL) {
+        text_ = new Text(span_, span_length_, true);
+    }
+    return text_;
+}
+
+void Node::ClearText() {
+    delete text_;
+    text_ = NULL;
+    span_ = NULL;
+    span_length_ = 0;
 }
 
 void Node::WriteNode() {
-    if (text_) {
+    if (text()) {
         fwrite(text_->string_, sizeof(char), text_->length_, stderr);
     }
-    if (next_) {
-        fputc('~', stderr);
-        next_->WriteNode();
-    }
 }
@@ -10,20 +10,39 @@
 
 class Text;
 
-// Node -- represents items in a simple linked lists.
+// Node -- represents an argument of a Context.
+//  The text of an argument is usually a span of the source that contains
+//  the call. The node keeps a view of the span, and wraps it in a Text only
+//  when asked for one. The source outlives the call's context.
+//  Nodes belong to the Arena of their Context, which runs their destructors.
 
 class Node {
  public:
   explicit Node(Text* t);
+  Node(const char* s, int len);
   virtual ~Node();
 
+  // text
+  // The raw text of the node, or NULL if it has none
+  Text*   text();
+
+  // ClearText
+  // Forget the raw text, as when the value is set directly
+  void    ClearText();
+
+  // hasText
+  bool    hasText() {
+    return this->text_ != 0 || this->span_ != 0;
+  }
+
   // WriteNode
-  // Recursively visit each node on the list and print the text
+  // Print the text of the node
   void    WriteNode();
 
+  const char* span_;          // view of the raw text in the source
+  int     span_length_;
   Text*   text_;
   Text*   value_;
-  Node*   next_;
 
 
   bool hasValue() {
@@ -10,8 +10,12 @@
 
 #include "text.h"
 #include "context.h"
+#include "file_cache.h"
+#include "file_writer.h"
 #include "hash_table.h"
 #include "node.h"
+#include "output_buffer.h"
+#include "program.h"
 
 OptionProcessor::OptionProcessor() {}
 
@@ -41,6 +45,50 @@ bool EvalProcessor::ProcessOption(int argc, const char *argv[],
   return true;
 }
 
+// The input is evaluated one complete top level piece at a time, so the
+// memory used depends on the size of the open macro calls rather than on
+// the size of the input. Output is written after every piece, which also
+// means that an error no longer suppresses the output before it.
+bool FlushProcessor::ProcessOption(int argc, const char * argv[],
+                                   const char * arg, int &cmd_arg,
+                                   int &frame_arg, Context* top_frame,
+                                   Text* in, Text* &the_output) {
+  TopLevelScanner scanner;
+  bool at_end = false;
+  int boundary;
+  int line = 0;
+  int character = 0;
+  int index = 0;
+
+  OutputBuffer::instance()->Write(stdout);
+  in->length_ = 0;
+  in->set_name("[standard input]");
+  while (!at_end) {
+    at_end = in->ReadStdInputChunk() == 0;
+    boundary = scanner.Scan(in, at_end);
+    at_end = at_end || scanner.ended();
+    if (boundary == 0) {
+      continue;
+    }
+    Text piece(in->string_, boundary);
+    piece.set_name(in->name_, in->name_length_);
+    Program program(&piece, line, character, index);
+    top_frame->EvaluateProgram(&program, the_output);
+    OutputBuffer::instance()->Write(stdout);
+
+    if (program.end_line() == 0) {
+      character += program.end_character();
+    } else {
+      character = program.end_character();
+    }
+    line += program.end_line();
+    index += boundary;
+    in->RemoveFromFront(boundary);
+    scanner.Consume(boundary);
+  }
+  return false;
+}
+
 bool GoProcessor::ProcessOption(int argc, const char * argv[],
                                 const char * arg, int &cmd_arg,
                                 int &frame_arg, Context* top_frame,
@@ -57,9 +105,11 @@ bool HelpProcessor::ProcessOption(int argc, const char * argv[],
                                   Text* in, Text* &the_output) {
   printf("  tilton command line parameters:\n"
          "    -eval <tilton expression>\n"
+         "    -flush\n"
          "    -go\n"
          "    -help\n"
          "    -include <filespec>\n"
+         "    -limit <depth>\n"
          "    -mute\n"
          "    -no\n"
          "    -read <filespec>\n"
@@ -76,17 +126,22 @@ bool IncludeProcessor::ProcessOption(int argc, const char * argv[],
                                      int &frame_arg, Context* top_frame,
                                      Text* in, Text* &the_output) {
   Text* name = NULL;
-  Text* string = NULL;
+  CachedFile* file = NULL;
   if (cmd_arg < argc) {
     name = new Text(argv[cmd_arg]);
     cmd_arg += 1;
-    string = new Text();
-    if (!string->ReadFromFile(name)) {
+    file = FileCache::Find(name);
+    if (file == NULL) {
       top_frame->ReportErrorAndDie("Error in -include", name);
     }
-    top_frame->ParseAndEvaluate(string, the_output);
+    Program* program = file->program();
+    if (program) {
+      top_frame->EvaluateProgram(program, the_output);
+    } else {
+      OutputBuffer::instance()->AddFile(the_output, file);
+    }
     delete name;
-    delete string;
+    file->Release();
   } else {
     top_frame->ReportErrorAndDie("Missing filename on -include");
   }
@@ -94,11 +149,32 @@ bool IncludeProcessor::ProcessOption(int argc, const char * argv[],
   return true;
 };
 
+bool LimitProcessor::ProcessOption(int argc, const char * argv[],
+                                   const char * arg, int &cmd_arg,
+                                   int &frame_arg, Context* top_frame,
+                                   Text* in, Text* &the_output) {
+  Text* depth = NULL;
+  if (cmd_arg < argc) {
+    depth = new Text(argv[cmd_arg]);
+    cmd_arg += 1;
+    number n = depth->getNumber();
+    if (n == kNAN || n < 1) {
+      top_frame->ReportErrorAndDie("Bad depth on -limit", depth);
+    }
+    Context::set_depth_limit(n > 1000000000 ? 1000000000 : static_cast<int>(n));
+    delete depth;
+  } else {
+    top_frame->ReportErrorAndDie("Missing depth on -limit");
+  }
+
+  return true;
+};
+
 bool MuteProcessor::ProcessOption(int argc, const char * argv[],
                                   const char * arg, int &cmd_arg,
                                   int &frame_arg, Context* top_frame,
                                   Text* in, Text* &the_output) {
-  the_output->length_ = 0;
+  OutputBuffer::instance()->Truncate(0);
   return true;
 };
 
@@ -115,17 +191,17 @@ bool ReadProcessor::ProcessOption(int argc, const char * argv[],
                                   int &frame_arg, Context* top_frame,
                                   Text* in, Text* &the_output) {
   Text* name = NULL;
-  Text* string = NULL;
+  CachedFile* file = NULL;
   if (cmd_arg < argc) {
   name = new Text(argv[cmd_arg]);
   cmd_arg += 1;
-  string = new Text();
-  if (!string->ReadFromFile(name)) {
+  file = FileCache::Find(name);
+  if (file == NULL) {
     top_frame->ReportErrorAndDie("Error in -read", name);
   }
-  the_output->AddToString(string);
+  OutputBuffer::instance()->AddFile(the_output, file);
   delete name;
-  delete string;
+  file->Release();
   } else {
     top_frame->ReportErrorAndDie("Missing filename on -read");
   }
@@ -162,10 +238,14 @@ bool WriteProcessor::ProcessOption(int argc, const char * argv[],
   if (cmd_arg < argc) {
     name = new Text(argv[cmd_arg]);
     cmd_arg += 1;
-    if (!the_output->WriteToFile(name)) {
+    if (!FileWriter::instance()->Flush()) {
+      top_frame->ReportErrorAndDie("Error in writing file",
+                                   FileWriter::instance()->failed());
+    }
+    if (!OutputBuffer::instance()->WriteToFile(name)) {
       top_frame->ReportErrorAndDie("Error in -write", name);
     }
-    the_output->length_ = 0;
+    FileCache::Changed(name);
     delete name;
   } else {
     top_frame->ReportErrorAndDie("Missing filename on -write");
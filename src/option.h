@@ -30,6 +30,16 @@ class EvalProcessor: public OptionProcessor {
                    Text* &the_output);
 };
 
+// FlushProcessor -- processor for the flush option
+
+class FlushProcessor: public OptionProcessor {
+ public:
+  // -flush (process the standard input now, writing output as it goes)
+  bool ProcessOption(int argc, const char * argv[], const char * arg,
+                     int &cmd_arg, int &frame_arg, Context* top_frame, Text* in,
+                     Text* &the_output);
+};
+
 // GoProcessor -- processor for the go option
 
 class GoProcessor: public OptionProcessor {
@@ -60,6 +70,16 @@ class IncludeProcessor: public OptionProcessor {
                      Text* &the_output);
 };
 
+// LimitProcessor -- processor for the limit option
+
+class LimitProcessor: public OptionProcessor {
+ public:
+  // -limit depth
+  bool ProcessOption(int argc, const char * argv[], const char * arg,
+                     int &cmd_arg, int &frame_arg, Context* top_frame, Text* in,
+                     Text* &the_output);
+};
+
 // MuteProcessor -- processor for the mute option
 
 class MuteProcessor: public OptionProcessor {
@@ -0,0 +1,266 @@
+// Copyright (c) 2011 Revelux Labs, LLC. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+#include "output_buffer.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "file_cache.h"
+#include "file_writer.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+OutputBuffer* OutputBuffer::pInstance = 0;
+
+OutputBuffer* OutputBuffer::instance() {
+  if ( pInstance == 0 ) {
+    pInstance = new OutputBuffer;
+  }
+  return pInstance;
+}
+
+OutputBuffer::OutputBuffer() {
+  text_ = NULL;
+  chunked_ = 0;
+  captures_ = 0;
+}
+
+OutputBuffer::~OutputBuffer() {
+  Drop(0);
+  for (size_t c = 0; c < spare_.size(); c += 1) {
+    delete[] spare_[c];
+  }
+}
+
+void OutputBuffer::AddFile(Text* the_output, CachedFile* file) {
+  Text* text = file->text();
+  if (the_output != text_ || captures_ != 0 || !file->mapped() ||
+      text->length_ < kChunkSize) {
+    the_output->AddToString(text);
+    return;
+  }
+  MoveToChunks();
+  Segment segment;
+  segment.data = text->string_;
+  segment.length = text->length_;
+  segment.bytes = NULL;
+  segment.capacity = 0;
+  segment.file = file;
+  file->Retain();
+  segments_.push_back(segment);
+  chunked_ += segment.length;
+}
+
+void OutputBuffer::CopyOut(Text* name) {
+  struct stat st;
+  if (stat(std::string(name->string_, name->length_).c_str(), &st) != 0) {
+    return;
+  }
+  for (size_t s = 0; s < segments_.size(); s += 1) {
+    Segment& segment = segments_[s];
+    if (segment.file && segment.file->IsFile(st)) {
+      segment.bytes = new char[segment.length];
+      segment.capacity = segment.length;
+      memmove(segment.bytes, segment.data, segment.length);
+      segment.data = segment.bytes;
+      segment.file->Release();
+      segment.file = NULL;
+    }
+  }
+}
+
+void OutputBuffer::Drop(size_t first) {
+  for (size_t s = first; s < segments_.size(); s += 1) {
+    if (segments_[s].file) {
+      segments_[s].file->Release();
+    } else if (segments_[s].capacity == kChunkSize) {
+      spare_.push_back(segments_[s].bytes);
+    } else {
+      delete[] segments_[s].bytes;
+    }
+  }
+  segments_.resize(first);
+}
+
+void OutputBuffer::MoveToChunks() {
+  const char* s = text_->string_;
+  int len = text_->length_;
+  while (len > 0) {
+    Segment* last = segments_.empty() ? NULL : &segments_.back();
+    if (last == NULL || last->bytes == NULL ||
+        last->length == last->capacity) {
+      Segment segment;
+      if (spare_.empty()) {
+        segment.bytes = new char[kChunkSize];
+      } else {
+        segment.bytes = spare_.back();
+        spare_.pop_back();
+      }
+      segment.data = segment.bytes;
+      segment.length = 0;
+      segment.capacity = kChunkSize;
+      segment.file = NULL;
+      segments_.push_back(segment);
+      last = &segments_.back();
+    }
+    long room = last->capacity - last->length;
+    int n = room < len ? static_cast<int>(room) : len;
+    memmove(last->bytes + last->length, s, n);
+    last->length += n;
+    s += n;
+    len -= n;
+    chunked_ += n;
+  }
+  text_->set_string(static_cast<const char*>(NULL), 0);
+}
+
+// The chunks are kept for the output that follows.
+void OutputBuffer::Truncate(long position) {
+  if (position >= chunked_) {
+    if (text_ && position - chunked_ < text_->length_) {
+      text_->substr(0, static_cast<int>(position - chunked_));
+    }
+    return;
+  }
+  if (position < 0) {
+    position = 0;
+  }
+  long at = 0;
+  size_t s = 0;
+  while (at + segments_[s].length <= position) {
+    at += segments_[s].length;
+    s += 1;
+  }
+  if (position > at) {
+    segments_[s].length = position - at;
+    s += 1;
+  }
+  Drop(s);
+  chunked_ = position;
+  if (text_) {
+    text_->set_string(static_cast<const char*>(NULL), 0);
+  }
+}
+
+// a write can stop short; it is taken up where it stopped
+static bool WriteVector(int fd, std::vector<struct iovec>* pieces) {
+  size_t next = 0;
+  while (next < pieces->size()) {
+    int count = static_cast<int>(pieces->size() - next);
+    if (count > IOV_MAX) {
+      count = IOV_MAX;
+    }
+    ssize_t written = writev(fd, &(*pieces)[next], count);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return false;
+    }
+    while (next < pieces->size() &&
+           static_cast<size_t>(written) >= (*pieces)[next].iov_len) {
+      written -= (*pieces)[next].iov_len;
+      next += 1;
+    }
+    if (written > 0) {
+      (*pieces)[next].iov_base =
+          static_cast<char*>((*pieces)[next].iov_base) + written;
+      (*pieces)[next].iov_len -= static_cast<size_t>(written);
+    }
+  }
+  pieces->clear();
+  return true;
+}
+
+long OutputBuffer::SendFile(int fd, const Segment& segment) {
+  int in = segment.file->Open();
+  if (in < 0) {
+    return 0;
+  }
+  off_t offset = segment.data - segment.file->text()->string_;
+  long sent = 0;
+  while (sent < segment.length) {
+    ssize_t n = sendfile(fd, in, &offset,
+                         static_cast<size_t>(segment.length - sent));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0 && sent == 0 && (errno == EINVAL || errno == ENOSYS)) {
+      break;
+    }
+    if (n <= 0) {
+      sent = -1;
+      break;
+    }
+    sent += n;
+  }
+  close(in);
+  return sent;
+}
+
+bool OutputBuffer::WriteAll(int fd) {
+  // the kernel can copy a file to a pipe or another file by itself
+  struct stat st;
+  bool sendable = fstat(fd, &st) == 0 &&
+                  (S_ISFIFO(st.st_mode) || S_ISREG(st.st_mode));
+  std::vector<struct iovec> pieces;
+  for (size_t s = 0; s < segments_.size(); s += 1) {
+    const Segment& segment = segments_[s];
+    long sent = 0;
+    if (segment.file && sendable) {
+      if (!WriteVector(fd, &pieces)) {
+        return false;
+      }
+      sent = SendFile(fd, segment);
+      if (sent < 0) {
+        return false;
+      }
+    }
+    if (sent < segment.length) {
+      struct iovec piece;
+      piece.iov_base = const_cast<char*>(segment.data) + sent;
+      piece.iov_len = static_cast<size_t>(segment.length - sent);
+      pieces.push_back(piece);
+    }
+  }
+  if (text_ && text_->length_ > 0) {
+    struct iovec piece;
+    piece.iov_base = text_->string_;
+    piece.iov_len = static_cast<size_t>(text_->length_);
+    pieces.push_back(piece);
+  }
+  return WriteVector(fd, &pieces);
+}
+
+bool OutputBuffer::Write(FILE* stream) {
+  fflush(stream);
+  bool ok = WriteAll(fileno(stream));
+  Truncate(0);
+  return ok;
+}
+
+bool OutputBuffer::WriteToFile(Text* name) {
+  CopyOut(name);
+  FileCache::CopyOut(name);
+  FileWriter* writer = FileWriter::instance();
+  std::string path(name->string_, name->length_);
+  std::string temp;
+  int fd = writer->Open(path, &temp);
+  if (fd < 0) {
+    return false;
+  }
+  bool ok = writer->Close(fd, path, temp, WriteAll(fd));
+  Truncate(0);
+  return ok;
+}
@@ -0,0 +1,124 @@
+// Copyright (c) 2011 Revelux Labs, LLC. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+#ifndef SRC_OUTPUT_BUFFER_H_
+#define SRC_OUTPUT_BUFFER_H_
+
+#include <stdio.h>
+
+#include <vector>
+
+#include "text.h"
+
+class CachedFile;
+
+// OutputBuffer -- singleton to hold the output of a run.
+//  Evaluation appends to a Text, the_output, and takes text back from its
+//  end to capture the value of an argument. Output that can no longer be
+//  taken back is moved out of the_output into chunks of kChunkSize bytes,
+//  so that the_output stays small instead of being copied each time it
+//  doubles as a large output grows. The chunks are written with writev,
+//  and followed by what is still in the_output.
+
+//  Output can be taken back only while an argument is being evaluated,
+//  between BeginCapture and EndCapture. When no capture is open, all of
+//  the_output is final.
+
+//  A big file that is read into final output is not copied at all. The
+//  output keeps a reference to the file, mapped in the cache, and writes
+//  it from the mapping, or has the kernel copy it with sendfile when the
+//  output goes to a pipe or a file.
+
+class OutputBuffer {
+ public:
+  OutputBuffer();
+  virtual ~OutputBuffer();
+
+  static OutputBuffer* instance();
+
+  // Attach
+  // Make text the_output, the end of the output
+  void    Attach(Text* text) { text_ = text; }
+
+  // BeginCapture, EndCapture
+  // Open and close a stretch in which the end of the_output may be taken
+  // back
+  void    BeginCapture() { captures_ += 1; }
+  void    EndCapture() { captures_ -= 1; }
+
+  // Spill
+  // Move the_output into the chunks, if it has grown to a chunk and none
+  // of it can be taken back. Evaluating into any other text is left alone.
+  void    Spill(Text* the_output) {
+    if (the_output->length_ >= kChunkSize && the_output == text_ &&
+        captures_ == 0) {
+      MoveToChunks();
+    }
+  }
+
+  // AddFile
+  // Append the text of a file to the_output, by reference if it is big,
+  // mapped and final, and by copying it if not
+  void    AddFile(Text* the_output, CachedFile* file);
+
+  // CopyOut
+  // Copy the output that refers to the file named, before it is written
+  // over
+  void    CopyOut(Text* name);
+
+  // length
+  // The length of the whole output
+  long    length() const { return chunked_ + (text_ ? text_->length_ : 0); }
+
+  // Truncate
+  // Drop the output from position on
+  void    Truncate(long position);
+
+  // Write
+  // Write the whole output to the stream, and empty it
+  bool    Write(FILE* stream);
+
+  // WriteToFile
+  // Write the whole output to the named file, and empty it
+  bool    WriteToFile(Text* name);
+
+ private:
+  // Segment -- a stretch of the output, in a chunk or in a file
+  struct Segment {
+    const char* data;
+    long        length;
+    char*       bytes;      // the chunk or copy holding data, or NULL
+    long        capacity;   // the size of bytes
+    CachedFile* file;       // the file holding data, retained, or NULL
+  };
+
+  // Drop
+  // Free the segments from first on
+  void    Drop(size_t first);
+
+  // MoveToChunks
+  // Append the_output to the chunks and empty it
+  void    MoveToChunks();
+
+  // SendFile
+  // Send a segment of a file to fd with sendfile. Returns the bytes sent,
+  // which may be none if the file cannot be sent, or -1 on error.
+  long    SendFile(int fd, const Segment& segment);
+
+  // WriteAll
+  // Write the output to fd
+  bool    WriteAll(int fd);
+
+  static const int kChunkSize = 65536;
+
+  static OutputBuffer* pInstance;
+
+  Text*                 text_;      // the_output
+  std::vector<Segment>  segments_;
+  std::vector<char*>    spare_;     // chunks to be used again
+  long                  chunked_;   // the bytes in the segments
+  int                   captures_;
+};
+
+#endif  // SRC_OUTPUT_BUFFER_H_
@@ -0,0 +1,369 @@
+// Copyright (c) 2011 Revelux Labs, LLC. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+#include "program.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "byte_scan.h"
+#include "byte_stream.h"
+#include "hash_table.h"
+#include "tilton.h"
+#include "text.h"
+
+Program::Program(Text* source) {
+  source_ = source;
+  owns_source_ = false;
+  parent_ = NULL;
+  references_ = 1;
+  kept_ = false;
+  Compile();
+}
+
+Program::Program(Text* source, bool owns_source) {
+  source_ = source;
+  owns_source_ = owns_source;
+  parent_ = NULL;
+  references_ = 1;
+  kept_ = false;
+  Compile();
+}
+
+Program::Program(Text* source, int line, int character, int index) {
+  source_ = source;
+  owns_source_ = false;
+  parent_ = NULL;
+  references_ = 1;
+  kept_ = false;
+  Compile();
+
+  // report positions relative to the whole source
+  for (size_t i = 0; i < instructions_.size(); i += 1) {
+    Instruction& op = instructions_[i];
+    if (op.line == 0) {
+      op.character += character;
+    }
+    op.line += line;
+    op.index += index;
+  }
+}
+
+Program::Program(Program* parent, const char* s, int len) {
+  source_ = new Text(s, len, true);
+  owns_source_ = true;
+  parent_ = parent;
+  references_ = 0;
+  kept_ = parent->kept_;
+  Compile();
+}
+
+Program::~Program() {
+  HashTable* table = MacroTable::instance()->macro_table();
+  for (size_t i = 0; i < instructions_.size(); i += 1) {
+    if (instructions_[i].symbol) {
+      table->Release(instructions_[i].symbol);
+    }
+  }
+  if (owns_source_) {
+    delete source_;
+  }
+  std::map<int, Program*>::iterator i;
+  for (i = subprograms_.begin(); i != subprograms_.end(); ++i) {
+    delete i->second;
+  }
+}
+
+void Program::Release() {
+  if (parent_) {
+    parent_->Release();
+    return;
+  }
+  references_ -= 1;
+  if (references_ == 0) {
+    delete this;
+  }
+}
+
+void Program::Keep() {
+  if (kept_) {
+    return;
+  }
+  kept_ = true;
+  HashTable* table = MacroTable::instance()->macro_table();
+  for (size_t i = 0; i < instructions_.size(); i += 1) {
+    Instruction& op = instructions_[i];
+    if (op.opcode == Instruction::kCall && op.literal_name && !op.symbol) {
+      const Span& name = arguments_[op.first_arg];
+      op.symbol = table->Intern(characters(name.start), name.length);
+      table->Retain(op.symbol);
+    }
+  }
+  std::map<int, Program*>::iterator i;
+  for (i = subprograms_.begin(); i != subprograms_.end(); ++i) {
+    i->second->Keep();
+  }
+}
+
+Program* Program::Subprogram(const char* s, int len) {
+  int offset = static_cast<int>(s - source_->string_);
+  Program*& program = subprograms_[offset];
+  if (program == NULL) {
+    program = new Program(this, s, len);
+  }
+  program->Retain();
+  return program;
+}
+
+const char* Program::characters(int offset) const {
+  return source_->string_ + offset;
+}
+
+// Compile follows the scanning rules of Tilton exactly. Outside of <~ ~>
+// everything is literal. Within <~ ~>, a run of at least as many tildes as
+// opened the call separates arguments, leftover tildes belong to the next
+// argument, and nested <~ ~> are kept as text for lazy evaluation.
+void Program::Compile() {
+  ByteStream in(source_);
+  Instruction call;
+  int c;                  // current character
+  int depth = 0;          // depth of nested <~ ~>
+  int tildes_seen = 0;    // the number of tildes in the separator ~~~
+  int run_length;         // the number of tildes currently under consideration
+  int here;               // index of the current character
+  int literal_start = 0;  // start of the literal run being scanned
+  int arg_start = 0;      // start of the argument being scanned
+
+  memset(&call, 0, sizeof(call));
+  end_line_ = end_character_ = 0;
+  for (;;) {
+    here = in.index();
+    switch ((c = in.next())) {
+      case '<':
+        run_length = checkForTilde(&in, 0);
+        if (depth > 0) {             // in middle of macro expansion
+          if (run_length > 0) {      // found embedded macro bracket
+            depth += 1;
+          }
+        } else if (run_length > 0) {  // found first macro bracket
+          AddLiteral(literal_start, here);
+          depth = 1;
+          tildes_seen = run_length;
+          memset(&call, 0, sizeof(call));
+          call.opcode = Instruction::kCall;
+          call.line = in.line();
+          call.character = in.character();
+          call.index = in.index();
+          call.first_arg = static_cast<int>(arguments_.size());
+          arg_start = in.index();
+        }
+        break;
+      case '~':
+        run_length = checkForTilde(&in, 1);
+
+        // if in middle of expansion and tildes seen, create args for each
+        if (depth == 1 && run_length >= tildes_seen) {
+          Span span = { arg_start, here - arg_start };
+          arguments_.push_back(span);
+          call.arg_count += 1;
+          for (;;) {
+            run_length -= tildes_seen;
+            if (run_length < tildes_seen) {
+              break;
+            }
+            Span empty = { in.index(), 0 };
+            arguments_.push_back(empty);
+            call.arg_count += 1;
+          }
+          // tildes left over from the separator begin the next argument
+          arg_start = in.index() - run_length;
+        }
+
+        // if we have seen the closing bracket
+        if (in.peek() == '>') {
+          in.next();
+          if (depth == 0) {
+            AddError(&in, "Extra ~>");
+            return;
+          }
+          depth -= 1;
+          if (depth == 0) {
+            if (run_length) {
+              call.opcode = Instruction::kError;
+              call.error = "Short ~>";
+              instructions_.push_back(call);
+              return;
+            }
+            AddCall(&call);
+            literal_start = in.index();
+          }
+        }
+        break;
+      case EOT:
+        end_line_ = in.line();
+        end_character_ = in.character() - 1;
+        if (depth > 0) {
+          call.opcode = Instruction::kError;
+          call.error = "Missing ~>";
+          instructions_.push_back(call);
+        } else {
+          AddLiteral(literal_start, here);
+        }
+        return;
+      default:
+        // copy the rest of a literal run in one step
+        in.Skip(ByteScan::FindSyntax(source_->string_ + in.index(),
+                                     source_->length_ - in.index()));
+        break;
+    }
+  }
+}
+
+void Program::AddLiteral(int start, int end) {
+  if (end > start) {
+    Instruction literal;
+    memset(&literal, 0, sizeof(literal));
+    literal.opcode = Instruction::kLiteral;
+    literal.start = start;
+    literal.length = end - start;
+    instructions_.push_back(literal);
+  }
+}
+
+void Program::AddCall(Instruction* call) {
+  const Span& name = arguments_[call->first_arg];
+  const char* s = characters(name.start);
+
+  // <~NUMBER~> and <~NUMBER~value~> refer to parameters
+  int number = -1;
+  if (name.length > 0 && Text::isDigit(s[0] - '0')) {
+    number = 0;
+    for (int i = 0; i < name.length; i += 1) {
+      if (!Text::isDigit(s[i] - '0')) {
+        number = -1;
+        break;
+      }
+      number = number * 10 + (s[i] - '0');
+    }
+  }
+  if (number >= 0) {
+    call->opcode = call->arg_count == 1 ? Instruction::kParameter
+                                        : Instruction::kSetParameter;
+    call->number = number;
+  } else {
+    call->literal_name = IsLiteralSpan(name);
+    if (call->literal_name) {
+      HashTable* table = MacroTable::instance()->macro_table();
+      call->symbol = kept_ ? table->Intern(s, name.length)
+                           : table->LookupSymbol(s, name.length);
+      if (call->symbol) {
+        table->Retain(call->symbol);
+      }
+    }
+  }
+  instructions_.push_back(*call);
+}
+
+void Program::AddError(ByteStream* in, const char* reason) {
+  Instruction error;
+  memset(&error, 0, sizeof(error));
+  error.opcode = Instruction::kError;
+  error.line = in->line();
+  error.character = in->character();
+  error.index = in->index();
+  error.first_arg = static_cast<int>(arguments_.size());
+  error.error = reason;
+  instructions_.push_back(error);
+}
+
+// A span without <~ evaluates to itself: a ~> within an argument would
+// have closed the call, so only literal text can remain.
+bool Program::IsLiteralSpan(const Span& span) const {
+  const char* s = characters(span.start);
+  for (int i = 0; i + 1 < span.length; i += 1) {
+    if (s[i] == '<' && s[i + 1] == '~') {
+      return false;
+    }
+  }
+  return true;
+}
+
+int Program::checkForTilde(ByteStream* in, int no) {
+  while (in->next() == '~') {
+    no += 1;
+  }
+  in->back();
+  return no;
+}
+
+TopLevelScanner::TopLevelScanner() {
+  boundary_ = depth_ = scanned_ = 0;
+  ended_ = false;
+}
+
+TopLevelScanner::~TopLevelScanner() {
+}
+
+int TopLevelScanner::Scan(Text* text, bool at_end) {
+  const char* s = text->string_;
+  int len = text->length_;
+  int i = scanned_;
+  int j;
+
+  while (i < len) {
+    switch (s[i]) {
+      case '<':
+        for (j = i + 1; j < len && s[j] == '~'; j += 1) {}
+        if (j == len && !at_end) {
+          scanned_ = i;  // the run may continue in the next piece
+          return boundary_;
+        }
+        if (j > i + 1) {  // found a macro bracket
+          depth_ += 1;
+        }
+        i = j;
+        break;
+      case '~':
+        for (j = i; j < len && s[j] == '~'; j += 1) {}
+        if (j == len && !at_end) {
+          scanned_ = i;
+          return boundary_;
+        }
+        // a ~> closes one level; at the top level it is an error that
+        // the compiled piece will report
+        if (j < len && s[j] == '>') {
+          j += 1;
+          if (depth_ > 0) {
+            depth_ -= 1;
+          }
+        }
+        i = j;
+        break;
+      default:
+        // a \377 reads as EOT, which ends the text
+        if (s[i] == EOT) {
+          ended_ = true;
+          scanned_ = boundary_ = i + 1;
+          return boundary_;
+        }
+        i += 1;
+        break;
+    }
+    // ByteStream looks one character past a \r, a < or a tilde run
+    if (depth_ == 0 && s[i - 1] != '\r' && s[i - 1] != '<' &&
+        s[i - 1] != '~') {
+      boundary_ = i;
+    }
+  }
+  scanned_ = i;
+  if (at_end) {
+    boundary_ = len;
+  }
+  return boundary_;
+}
+
+void TopLevelScanner::Consume(int count) {
+  boundary_ -= count;
+  scanned_ -= count;
+}
@@ -0,0 +1,190 @@
+// Copyright (c) 2011 Revelux Labs, LLC. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+#ifndef SRC_PROGRAM_H_
+#define SRC_PROGRAM_H_
+
+#include <map>
+#include <vector>
+
+#include "tilton.h"
+
+class ByteStream;
+class Symbol;
+class Text;
+
+// Instruction -- one step of a compiled Program.
+//  A literal names a run of source text that is copied to the output.
+//  A parameter is <~NUMBER~>, a set parameter is <~NUMBER~value~>, and a
+//  call is any other <~ ~> with its argument spans. An error records a
+//  syntax error at the point where the scanner would have reported it.
+
+struct Instruction {
+  enum Opcode { kLiteral, kParameter, kSetParameter, kCall, kError };
+
+  Opcode      opcode;
+  int         start;        // kLiteral: offset of the run in the source
+  int         length;       // kLiteral: length of the run
+  int         number;       // kParameter, kSetParameter: parameter number
+  int         first_arg;    // index of the first argument span
+  int         arg_count;    // number of argument spans
+  int         line;         // source position for error messages
+  int         character;
+  int         index;
+  const char* error;        // kError: the reason
+  bool        literal_name; // kCall: the name needs no evaluation
+  Symbol*     symbol;       // kCall: the symbol of the literal name, if any
+};
+
+// Span -- an argument as an offset and a length into the source.
+
+struct Span {
+  int start;
+  int length;
+};
+
+// Program -- the compiled form of a text.
+//  A Program scans a text once and records what evaluating it means:
+//  literal runs, parameter references, and macro calls whose arguments are
+//  spans of the source. Context::EvaluateProgram runs it without looking at
+//  the characters again. A Macro keeps the Program of its definition so
+//  that calling it does not rescan the body.
+
+//  Programs owned by a Macro are reference counted, because a macro can be
+//  redefined while its old definition is still running. A Program compiled
+//  from one of the argument spans of another belongs to that parent, and a
+//  reference to it is a reference to the parent.
+
+//  A Program holds a reference to the Symbol of each name it calls, so the
+//  symbol outlives the macro of that name while the program can still run.
+//  A Program that is run once and thrown away only looks up the names it
+//  calls, and a name that is not known yet is looked up again when it is
+//  called. A Program that is kept, for a macro or a cached file, interns its
+//  names with Keep.
+
+class Program {
+ public:
+  // Compile a text that outlives the program
+  explicit Program(Text* source);
+  // Compile a text that the program takes over
+  Program(Text* source, bool owns_source);
+  // Compile a text that continues a source at line, character and index
+  Program(Text* source, int line, int character, int index);
+  virtual ~Program();
+
+  // Retain
+  // Take a reference to the program
+  void    Retain() {
+    if (parent_) {
+      parent_->Retain();
+    } else {
+      references_ += 1;
+    }
+  }
+
+  // Release
+  // Drop a reference, deleting the program with the last one
+  void    Release();
+
+  // Keep
+  // Intern the names of the calls, because the program will be run again
+  void    Keep();
+
+  // Subprogram
+  // The program of len characters of the source starting at s, which is
+  // compiled the first time it is asked for. The reference is retained.
+  Program* Subprogram(const char* s, int len);
+
+  // argument
+  // Retrieve an argument span
+  const Span& argument(int i) const { return arguments_[i]; }
+
+  // characters
+  // The source characters starting at offset
+  const char* characters(int offset) const;
+
+  const std::vector<Instruction>& instructions() const {
+    return instructions_;
+  }
+
+  Text*   source() const { return source_; }
+
+  // end_line, end_character
+  // The position reached at the end of the source
+  int     end_line() const { return end_line_; }
+  int     end_character() const { return end_character_; }
+
+ private:
+  // Compile a span of the source of parent
+  Program(Program* parent, const char* s, int len);
+
+  // Compile
+  // Scan the source and produce the instructions
+  void    Compile();
+
+  // AddLiteral
+  // Append a literal run, unless it is empty
+  void    AddLiteral(int start, int end);
+
+  // AddCall
+  // Classify a completed <~ ~> and append it
+  void    AddCall(Instruction* call);
+
+  // AddError
+  // Append an error at the current stream position
+  void    AddError(ByteStream* in, const char* reason);
+
+  // IsLiteralSpan
+  // Tests to determine if a span contains no macro brackets
+  bool    IsLiteralSpan(const Span& span) const;
+
+  // checkForTilde
+  // Examines the input stream for a run of tildes
+  // Returns the number of consecutive tildes at the beginning
+  // of the stream and removes them
+  int     checkForTilde(ByteStream* in, int no);
+
+  std::vector<Instruction>  instructions_;
+  std::vector<Span>         arguments_;
+  Text*                     source_;
+  bool                      owns_source_;
+  Program*                  parent_;
+  std::map<int, Program*>   subprograms_;   // by offset in the source
+  int                       references_;
+  bool                      kept_;          // the names are interned
+  int                       end_line_;
+  int                       end_character_;
+};
+
+// TopLevelScanner -- finds where complete top level text ends.
+//  A stream can be evaluated piece by piece: every byte before a boundary
+//  can be compiled and run without seeing the rest of the input, because no
+//  <~ ~> is open there and no bracket, tilde run or line end is cut in half.
+
+class TopLevelScanner {
+ public:
+  TopLevelScanner();
+  virtual ~TopLevelScanner();
+
+  // Scan
+  // Continue scanning the text and return the last boundary found.
+  // At the end of the input everything scanned is complete.
+  int     Scan(Text* text, bool at_end);
+
+  // Consume
+  // Forget the first count bytes, which the caller has evaluated
+  void    Consume(int count);
+
+  // ended
+  // Tests to determine if the text ended before the input did
+  bool    ended() const { return ended_; }
+
+ private:
+  int     boundary_;     // the last boundary found
+  bool    ended_;
+  int     depth_;        // depth of nested <~ ~> at scanned_
+  int     scanned_;      // bytes examined so far
+};
+
+#endif  // SRC_PROGRAM_H_
@@ -0,0 +1,878 @@
+// Copyright (c) 2011 Revelux Labs, LLC. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+#include "regex.h"
+
+#include <limits.h>
+#include <string.h>
+
+#include <algorithm>
+
+// The instructions of a program. A byte or a class consumes one byte of
+// the text; the rest are followed when a thread is added.
+enum {
+  kOpByte,      // x is the byte
+  kOpClass,     // x is the class
+  kOpSplit,     // go to x, and with less priority to y
+  kOpJump,      // go to x
+  kOpSave,      // note the position in capture x
+  kOpBegin,     // at the start of the text
+  kOpEnd,       // at the end of the text
+  kOpMatch
+};
+
+// A pattern is parsed into a tree of these, which is then compiled. A
+// concatenation or an alternation of many parts is a chain down the left.
+struct RegexNode {
+  enum Type { kEmpty, kByte, kClass, kConcat, kAlternate, kStar, kPlus,
+              kQuest, kGroup, kBegin, kEnd };
+  Type  type;
+  int   value;      // the byte, the class, or the group
+  int   left;
+  int   right;
+  bool  greedy;
+  int   depth;      // the nesting of calls that compiling it takes
+};
+
+// RegexParser -- turns a pattern into the program of a Regex.
+class RegexParser {
+ public:
+  RegexParser(Regex* regex, const char* pattern, int len) {
+    regex_ = regex;
+    p_ = reinterpret_cast<const unsigned char*>(pattern);
+    len_ = len;
+    i_ = 0;
+    error_ = NULL;
+    nesting_ = 0;
+  }
+
+  // Parse
+  // Parse the whole pattern and compile it, returning NULL or the reason
+  // it is bad
+  const char* Parse() {
+    int root = ParseAlternation();
+    if (error_ == NULL && i_ < len_) {
+      error_ = "Unmatched )";
+    }
+    if (error_ == NULL) {
+      Emit(kOpSave, 0);
+      Compile(root);
+      Emit(kOpSave, 1);
+      Emit(kOpMatch, 0);
+    }
+    if (error_ == NULL &&
+        static_cast<int>(regex_->program_.size()) > kMaxProgram) {
+      error_ = "Pattern too large";
+    }
+    return error_;
+  }
+
+ private:
+  static const int kMaxProgram = 100000;
+  static const int kMaxRepeat = 1000;
+  static const int kMaxDepth = 5000;    // of a node, which limits recursion
+  static const int kMaxNesting = 1000;  // of groups while parsing
+
+  // NewNode
+  // A node, whose depth counts what Compile and CanBeEmpty recurse into.
+  // They walk a chain down the left in a loop, so it adds nothing.
+  int     NewNode(RegexNode::Type type, int value, int left, int right) {
+    int depth = 0;
+    if (left >= 0) {
+      bool chain = (type == RegexNode::kConcat ||
+                    type == RegexNode::kAlternate) &&
+                   nodes_[left].type == type;
+      depth = nodes_[left].depth + (chain ? 0 : 1);
+    }
+    if (right >= 0 && nodes_[right].depth + 1 > depth) {
+      depth = nodes_[right].depth + 1;
+    }
+    if (depth > kMaxDepth && error_ == NULL) {
+      error_ = "Pattern too large";
+    }
+    RegexNode node = { type, value, left, right, true, depth };
+    nodes_.push_back(node);
+    return static_cast<int>(nodes_.size()) - 1;
+  }
+
+  // Chain
+  // The parts of a chain of nodes of the type of n, from the left. A node
+  // of another type is a chain of one.
+  void    Chain(int n, std::vector<int>* parts) {
+    RegexNode::Type type = nodes_[n].type;
+    parts->clear();
+    while (nodes_[n].type == type &&
+           (type == RegexNode::kConcat || type == RegexNode::kAlternate)) {
+      parts->push_back(nodes_[n].right);
+      n = nodes_[n].left;
+    }
+    parts->push_back(n);
+    std::reverse(parts->begin(), parts->end());
+  }
+
+  int     Concat(int left, int right) {
+    if (left < 0 || nodes_[left].type == RegexNode::kEmpty) {
+      return right;
+    }
+    return NewNode(RegexNode::kConcat, 0, left, right);
+  }
+
+  int     Alternate(int left, int right) {
+    return left < 0 ? right : NewNode(RegexNode::kAlternate, 0, left, right);
+  }
+
+  int     Repeat(RegexNode::Type type, int node, bool greedy) {
+    int n = NewNode(type, 0, node, -1);
+    nodes_[n].greedy = greedy;
+    return n;
+  }
+
+  // NewClass
+  // A node for a class of bytes
+  int     NewClass(const bool* set) {
+    int number = static_cast<int>(regex_->classes_.size() / 32);
+    for (int b = 0; b < 256; b += 8) {
+      unsigned char bits = 0;
+      for (int k = 0; k < 8; k += 1) {
+        if (set[b + k]) {
+          bits |= static_cast<unsigned char>(1 << k);
+        }
+      }
+      regex_->classes_.push_back(bits);
+    }
+    return NewNode(RegexNode::kClass, number, -1, -1);
+  }
+
+  int     ByteRange(int first, int last) {
+    bool set[256] = { false };
+    for (int b = first; b <= last; b += 1) {
+      set[b] = true;
+    }
+    return NewClass(set);
+  }
+
+  // AnyMultibyte
+  // Any character of several bytes, or a stray byte that cannot begin one
+  int     AnyMultibyte() {
+    int two = Concat(ByteRange(0xC0, 0xDF), ByteRange(0x80, 0xBF));
+    int three = Concat(Concat(ByteRange(0xE0, 0xEF), ByteRange(0x80, 0xBF)),
+                       ByteRange(0x80, 0xBF));
+    int four = Concat(Concat(Concat(ByteRange(0xF0, 0xF7),
+                                    ByteRange(0x80, 0xBF)),
+                             ByteRange(0x80, 0xBF)),
+                      ByteRange(0x80, 0xBF));
+    bool stray[256] = { false };
+    for (int b = 0x80; b < 0x100; b += 1) {
+      stray[b] = b < 0xC0 || b >= 0xF8;
+    }
+    return Alternate(Alternate(Alternate(two, three), four), NewClass(stray));
+  }
+
+  // SequenceLength
+  // The length of the UTF-8 character at i, or 1 if it is not one
+  int     SequenceLength(int i) {
+    int c = p_[i];
+    int n = c >= 0xF0 && c <= 0xF7 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+    if (c >= 0xF8 || i + n > len_) {
+      return 1;
+    }
+    for (int k = 1; k < n; k += 1) {
+      if ((p_[i + k] & 0xC0) != 0x80) {
+        return 1;
+      }
+    }
+    return n;
+  }
+
+  // Literal
+  // The character at i_, consumed as one atom
+  int     Literal() {
+    int n = SequenceLength(i_);
+    int node = -1;
+    for (int k = 0; k < n; k += 1) {
+      node = Concat(node, NewNode(RegexNode::kByte, p_[i_ + k], -1, -1));
+    }
+    i_ += n;
+    return node;
+  }
+
+  // AddEscapeClass
+  // Add the bytes of \d, \w or \s to the set. Returns false if the
+  // escape is not one of them.
+  static bool AddEscapeClass(int c, bool* set) {
+    for (int b = 0; b < 128; b += 1) {
+      bool in;
+      switch (c) {
+        case 'd':
+          in = b >= '0' && b <= '9';
+          break;
+        case 'w':
+          in = (b >= '0' && b <= '9') || (b >= 'a' && b <= 'z') ||
+               (b >= 'A' && b <= 'Z') || b == '_';
+          break;
+        case 's':
+          in = b == ' ' || (b >= '\t' && b <= '\r');
+          break;
+        default:
+          return false;
+      }
+      if (in) {
+        set[b] = true;
+      }
+    }
+    return true;
+  }
+
+  static int EscapedByte(int c) {
+    switch (c) {
+      case 'n':
+        return '\n';
+      case 'r':
+        return '\r';
+      case 't':
+        return '\t';
+      case 'f':
+        return '\f';
+      case 'v':
+        return '\v';
+      default:
+        return c;
+    }
+  }
+
+  int     ParseAlternation() {
+    int node = ParseConcatenation();
+    while (error_ == NULL && i_ < len_ && p_[i_] == '|') {
+      i_ += 1;
+      node = NewNode(RegexNode::kAlternate, 0, node, ParseConcatenation());
+    }
+    return node;
+  }
+
+  int     ParseConcatenation() {
+    int node = NewNode(RegexNode::kEmpty, 0, -1, -1);
+    while (error_ == NULL && i_ < len_ && p_[i_] != '|' && p_[i_] != ')') {
+      node = Concat(node, ParseRepetition());
+    }
+    return node;
+  }
+
+  int     ParseRepetition() {
+    int node = ParseAtom();
+    while (error_ == NULL && i_ < len_) {
+      RegexNode::Type type;
+      int min = 0;
+      int max = -1;
+      switch (p_[i_]) {
+        case '*':
+          type = RegexNode::kStar;
+          break;
+        case '+':
+          type = RegexNode::kPlus;
+          break;
+        case '?':
+          type = RegexNode::kQuest;
+          break;
+        case '{':
+          if (!ParseCounts(&min, &max)) {
+            error_ = "Bad repetition";
+            return node;
+          }
+          type = RegexNode::kEmpty;
+          break;
+        default:
+          return node;
+      }
+      if (type != RegexNode::kEmpty) {
+        i_ += 1;
+      }
+      bool greedy = true;
+      if (i_ < len_ && p_[i_] == '?') {
+        greedy = false;
+        i_ += 1;
+      }
+      if (type != RegexNode::kEmpty) {
+        node = Repeat(type, node, greedy);
+      } else {
+        node = Counted(node, min, max, greedy);
+      }
+    }
+    return node;
+  }
+
+  // ParseCounts
+  // Parse {n}, {n,} or {n,m} at i_
+  bool    ParseCounts(int* min, int* max) {
+    int i = i_ + 1;
+    int n = 0;
+    int digits = 0;
+    while (i < len_ && p_[i] >= '0' && p_[i] <= '9' && n <= kMaxRepeat) {
+      n = n * 10 + (p_[i] - '0');
+      i += 1;
+      digits += 1;
+    }
+    if (digits == 0) {
+      return false;
+    }
+    *min = *max = n;
+    if (i < len_ && p_[i] == ',') {
+      i += 1;
+      *max = -1;
+      if (i < len_ && p_[i] >= '0' && p_[i] <= '9') {
+        n = 0;
+        while (i < len_ && p_[i] >= '0' && p_[i] <= '9' && n <= kMaxRepeat) {
+          n = n * 10 + (p_[i] - '0');
+          i += 1;
+        }
+        *max = n;
+      }
+    }
+    if (i >= len_ || p_[i] != '}' || *min > kMaxRepeat || *max > kMaxRepeat ||
+        (*max >= 0 && *max < *min)) {
+      return false;
+    }
+    i_ = i + 1;
+    return true;
+  }
+
+  // Counted
+  // node{min,max} as min copies of node followed by optional ones. The
+  // copies share the node, which is compiled once for each.
+  int     Counted(int node, int min, int max, bool greedy) {
+    int result = NewNode(RegexNode::kEmpty, 0, -1, -1);
+    for (int k = 0; k < min; k += 1) {
+      result = Concat(result, node);
+    }
+    if (max < 0) {
+      return Concat(result, Repeat(RegexNode::kStar, node, greedy));
+    }
+    int optional = -1;
+    for (int k = min; k < max; k += 1) {
+      int inner = optional < 0 ? node
+                  : NewNode(RegexNode::kConcat, 0, node, optional);
+      optional = Repeat(RegexNode::kQuest, inner, greedy);
+    }
+    return optional < 0 ? result : Concat(result, optional);
+  }
+
+  int     ParseAtom() {
+    int c = p_[i_];
+    bool set[256] = { false };
+    switch (c) {
+      case '(': {
+        if (nesting_ >= kMaxNesting) {
+          error_ = "Pattern too large";
+          return -1;
+        }
+        i_ += 1;
+        int group = -1;
+        if (i_ + 1 < len_ && p_[i_] == '?' && p_[i_ + 1] == ':') {
+          i_ += 2;
+        } else {
+          regex_->group_count_ += 1;
+          group = regex_->group_count_;
+        }
+        nesting_ += 1;
+        int node = ParseAlternation();
+        nesting_ -= 1;
+        if (error_) {
+          return node;
+        }
+        if (i_ >= len_ || p_[i_] != ')') {
+          error_ = "Missing )";
+          return node;
+        }
+        i_ += 1;
+        return group < 0 ? node : NewNode(RegexNode::kGroup, group, node, -1);
+      }
+      case '*':
+      case '+':
+      case '?':
+      case '{':
+        error_ = "Nothing to repeat";
+        return -1;
+      case '[':
+        return ParseClass();
+      case '.':
+        i_ += 1;
+        for (int b = 0; b < 128; b += 1) {
+          set[b] = b != '\n';
+        }
+        return Alternate(NewClass(set), AnyMultibyte());
+      case '^':
+        i_ += 1;
+        return NewNode(RegexNode::kBegin, 0, -1, -1);
+      case '$':
+        i_ += 1;
+        return NewNode(RegexNode::kEnd, 0, -1, -1);
+      case '\\':
+        i_ += 1;
+        if (i_ >= len_) {
+          error_ = "Trailing \\";
+          return -1;
+        }
+        c = p_[i_];
+        if (AddEscapeClass(c, set)) {
+          i_ += 1;
+          return NewClass(set);
+        }
+        if (AddEscapeClass(c - 'A' + 'a', set)) {
+          i_ += 1;
+          for (int b = 0; b < 128; b += 1) {
+            set[b] = !set[b];
+          }
+          return Alternate(NewClass(set), AnyMultibyte());
+        }
+        if (c < 0x80) {
+          i_ += 1;
+          return NewNode(RegexNode::kByte, EscapedByte(c), -1, -1);
+        }
+        return Literal();
+      default:
+        return Literal();
+    }
+  }
+
+  int     ParseClass() {
+    bool set[256] = { false };
+    bool negate = false;
+    bool multibyte = false;   // any character of several bytes
+    int sequences = -1;       // the characters of several bytes
+    i_ += 1;
+    if (i_ < len_ && p_[i_] == '^') {
+      negate = true;
+      i_ += 1;
+    }
+    bool first = true;
+    while (i_ < len_ && (p_[i_] != ']' || first)) {
+      first = false;
+      int c = p_[i_];
+      if (c == '\\' && i_ + 1 < len_) {
+        int e = p_[i_ + 1];
+        if (AddEscapeClass(e, set)) {
+          i_ += 2;
+          continue;
+        }
+        bool others[256] = { false };
+        if (AddEscapeClass(e - 'A' + 'a', others)) {
+          for (int b = 0; b < 128; b += 1) {
+            set[b] = set[b] || !others[b];
+          }
+          multibyte = true;
+          i_ += 2;
+          continue;
+        }
+        i_ += 1;
+        c = e < 0x80 ? EscapedByte(e) : e;
+      }
+      if (c >= 0x80) {
+        int n = SequenceLength(i_);
+        if (n == 1) {
+          set[c] = true;
+          i_ += 1;
+        } else {
+          sequences = Alternate(sequences, Literal());
+        }
+        continue;
+      }
+      i_ += 1;
+      int last = c;
+      if (i_ + 1 < len_ && p_[i_] == '-' && p_[i_ + 1] != ']') {
+        last = p_[i_ + 1];
+        if (last == '\\' && i_ + 2 < len_) {
+          last = EscapedByte(p_[i_ + 2]);
+          i_ += 1;
+        }
+        if (last >= 0x80 || last < c) {
+          error_ = "Bad class";
+          return -1;
+        }
+        i_ += 2;
+      }
+      for (int b = c; b <= last; b += 1) {
+        set[b] = true;
+      }
+    }
+    if (i_ >= len_) {
+      error_ = "Missing ]";
+      return -1;
+    }
+    i_ += 1;
+    if (negate) {
+      if (multibyte || sequences >= 0) {
+        error_ = "Bad class";
+        return -1;
+      }
+      for (int b = 0; b < 128; b += 1) {
+        set[b] = !set[b];
+      }
+      for (int b = 128; b < 256; b += 1) {
+        set[b] = false;
+      }
+      return Alternate(NewClass(set), AnyMultibyte());
+    }
+    int node = NewClass(set);
+    if (sequences >= 0) {
+      node = Alternate(sequences, node);
+    }
+    if (multibyte) {
+      node = Alternate(node, AnyMultibyte());
+    }
+    return node;
+  }
+
+  int     Emit(int opcode, int x) {
+    Regex::Inst inst = { opcode, x, 0 };
+    regex_->program_.push_back(inst);
+    return static_cast<int>(regex_->program_.size()) - 1;
+  }
+
+  int     here() const { return static_cast<int>(regex_->program_.size()); }
+
+  // Compile
+  // Append the code of a node
+  void    Compile(int n) {
+    if (n < 0 || here() > kMaxProgram) {
+      return;
+    }
+    const RegexNode node = nodes_[n];
+    std::vector<Regex::Inst>& code = regex_->program_;
+    std::vector<int> parts;
+    std::vector<int> jumps;
+    int split;
+    int jump;
+    switch (node.type) {
+      case RegexNode::kEmpty:
+        break;
+      case RegexNode::kByte:
+        Emit(kOpByte, node.value);
+        break;
+      case RegexNode::kClass:
+        Emit(kOpClass, node.value);
+        break;
+      case RegexNode::kConcat:
+        Chain(n, &parts);
+        for (size_t k = 0; k < parts.size(); k += 1) {
+          Compile(parts[k]);
+        }
+        break;
+      case RegexNode::kAlternate:
+        // each way but the last is tried first, then jumps to the end
+        Chain(n, &parts);
+        for (size_t k = 0; k + 1 < parts.size(); k += 1) {
+          split = Emit(kOpSplit, 0);
+          Compile(parts[k]);
+          jumps.push_back(Emit(kOpJump, 0));
+          code[split].x = split + 1;
+          code[split].y = here();
+        }
+        Compile(parts.back());
+        for (size_t k = 0; k < jumps.size(); k += 1) {
+          code[jumps[k]].x = here();
+        }
+        break;
+      case RegexNode::kStar:
+        split = Emit(kOpSplit, 0);
+        Compile(node.left);
+        if (CanBeEmpty(node.left)) {
+          // as (e+)?, so that an empty time round ends the loop, as it
+          // does for a backtracking matcher, instead of killing the thread
+          jump = Emit(kOpSplit, 0);
+          Prefer(jump, split + 1, here(), node.greedy);
+        } else {
+          Emit(kOpJump, split);
+        }
+        Prefer(split, split + 1, here(), node.greedy);
+        break;
+      case RegexNode::kPlus: {
+        int start = here();
+        Compile(node.left);
+        split = Emit(kOpSplit, 0);
+        Prefer(split, start, here(), node.greedy);
+        break;
+      }
+      case RegexNode::kQuest:
+        split = Emit(kOpSplit, 0);
+        Compile(node.left);
+        Prefer(split, split + 1, here(), node.greedy);
+        break;
+      case RegexNode::kGroup:
+        Emit(kOpSave, node.value * 2);
+        Compile(node.left);
+        Emit(kOpSave, node.value * 2 + 1);
+        break;
+      case RegexNode::kBegin:
+        Emit(kOpBegin, 0);
+        break;
+      case RegexNode::kEnd:
+        Emit(kOpEnd, 0);
+        break;
+    }
+  }
+
+  // CanBeEmpty
+  // Whether the node can match without consuming anything
+  bool    CanBeEmpty(int n) {
+    if (empty_.size() < nodes_.size()) {
+      empty_.resize(nodes_.size(), -1);
+    }
+    if (empty_[n] < 0) {
+      const RegexNode& node = nodes_[n];
+      bool can;
+      switch (node.type) {
+        case RegexNode::kByte:
+        case RegexNode::kClass:
+          can = false;
+          break;
+        case RegexNode::kConcat:
+        case RegexNode::kAlternate: {
+          // every part can be empty, or any way can
+          bool all = node.type == RegexNode::kConcat;
+          std::vector<int> parts;
+          Chain(n, &parts);
+          can = all;
+          for (size_t k = 0; k < parts.size() && can == all; k += 1) {
+            can = CanBeEmpty(parts[k]);
+          }
+          break;
+        }
+        case RegexNode::kPlus:
+        case RegexNode::kGroup:
+          can = CanBeEmpty(node.left);
+          break;
+        default:
+          can = true;
+          break;
+      }
+      empty_[n] = can ? 1 : 0;
+    }
+    return empty_[n] == 1;
+  }
+
+  // Prefer
+  // Point a split at the way to repeat and the way out, in the order the
+  // repetition prefers them
+  void    Prefer(int split, int repeat, int out, bool greedy) {
+    regex_->program_[split].x = greedy ? repeat : out;
+    regex_->program_[split].y = greedy ? out : repeat;
+  }
+
+  Regex*  regex_;
+  const unsigned char* p_;
+  int     len_;
+  int     i_;
+  const char* error_;
+  int     nesting_;           // the groups open at i_
+  std::vector<RegexNode> nodes_;
+  std::vector<signed char> empty_;    // by node: -1 until CanBeEmpty knows
+};
+
+std::map<std::string, Regex*>* Regex::cache_ = NULL;
+
+Regex::Regex() {
+  group_count_ = 0;
+  capture_count_ = 2;
+  first_known_ = false;
+  step_ = 0;
+}
+
+Regex::~Regex() {
+}
+
+Regex* Regex::Find(const char* pattern, int len, const char** error) {
+  if (cache_ == NULL) {
+    cache_ = new std::map<std::string, Regex*>();
+  }
+  std::string key(pattern, len);
+  std::map<std::string, Regex*>::iterator found = cache_->find(key);
+  if (found != cache_->end()) {
+    return found->second;
+  }
+  Regex* regex = new Regex();
+  *error = regex->Compile(pattern, len);
+  if (*error) {
+    delete regex;
+    return NULL;
+  }
+  (*cache_)[key] = regex;
+  return regex;
+}
+
+const char* Regex::Compile(const char* pattern, int len) {
+  RegexParser parser(this, pattern, len);
+  const char* error = parser.Parse();
+  if (error) {
+    return error;
+  }
+  capture_count_ = 2 * (group_count_ + 1);
+  int size = static_cast<int>(program_.size());
+  for (int l = 0; l < 2; l += 1) {
+    lists_[l].pcs.reserve(size);
+    lists_[l].captures.resize(size * capture_count_);
+    lists_[l].marks.assign(size, -1);
+  }
+  FindFirstBytes();
+  return NULL;
+}
+
+// Follow the program from the start without consuming anything. If every
+// way reaches a byte or a class, a match must begin with one of them.
+void Regex::FindFirstBytes() {
+  std::vector<bool> seen(program_.size(), false);
+  std::vector<int> pending(1, 0);
+  memset(first_bytes_, 0, sizeof(first_bytes_));
+  first_known_ = true;
+  while (!pending.empty()) {
+    int pc = pending.back();
+    pending.pop_back();
+    if (seen[pc]) {
+      continue;
+    }
+    seen[pc] = true;
+    const Inst& inst = program_[pc];
+    switch (inst.opcode) {
+      case kOpByte:
+        first_bytes_[inst.x] = true;
+        break;
+      case kOpClass:
+        for (int b = 0; b < 256; b += 1) {
+          if (classes_[inst.x * 32 + b / 8] & (1 << (b % 8))) {
+            first_bytes_[b] = true;
+          }
+        }
+        break;
+      case kOpSplit:
+        pending.push_back(inst.x);
+        pending.push_back(inst.y);
+        break;
+      case kOpJump:
+        pending.push_back(inst.x);
+        break;
+      case kOpSave:
+        pending.push_back(pc + 1);
+        break;
+      default:
+        first_known_ = false;
+        return;
+    }
+  }
+}
+
+// The closure is followed with an explicit stack. A save pushes the value
+// it replaces, which is put back before the next way is tried, so the
+// captures passed in are what every thread added starts from.
+void Regex::AddThread(ThreadList* list, int pc, int* captures, int pos,
+                      int len) {
+  stack_.clear();
+  stack_.push_back(pc);
+  while (!stack_.empty()) {
+    pc = stack_.back();
+    stack_.pop_back();
+    if (pc < 0) {
+      // restore a capture: -1 - slot, then the value
+      int slot = -1 - pc;
+      captures[slot] = stack_.back();
+      stack_.pop_back();
+      continue;
+    }
+    for (;;) {
+      if (list->marks[pc] == step_) {
+        break;
+      }
+      list->marks[pc] = step_;
+      const Inst& inst = program_[pc];
+      if (inst.opcode == kOpJump) {
+        pc = inst.x;
+      } else if (inst.opcode == kOpSplit) {
+        stack_.push_back(inst.y);
+        pc = inst.x;
+      } else if (inst.opcode == kOpSave) {
+        stack_.push_back(captures[inst.x]);
+        stack_.push_back(-1 - inst.x);
+        captures[inst.x] = pos;
+        pc += 1;
+      } else if (inst.opcode == kOpBegin) {
+        if (pos != 0) {
+          break;
+        }
+        pc += 1;
+      } else if (inst.opcode == kOpEnd) {
+        if (pos != len) {
+          break;
+        }
+        pc += 1;
+      } else {
+        int row = static_cast<int>(list->pcs.size());
+        list->pcs.push_back(pc);
+        memcpy(&list->captures[row * capture_count_], captures,
+               capture_count_ * sizeof(int));
+        break;
+      }
+    }
+  }
+}
+
+bool Regex::Match(const char* text, int len, int start, int* captures) {
+  const unsigned char* s = reinterpret_cast<const unsigned char*>(text);
+  ThreadList* current = &lists_[0];
+  ThreadList* next = &lists_[1];
+  std::vector<int> initial(capture_count_, -1);
+  bool matched = false;
+
+  if (step_ > INT_MAX - 2 * len - 4) {
+    for (int l = 0; l < 2; l += 1) {
+      lists_[l].marks.assign(lists_[l].marks.size(), -1);
+    }
+    step_ = 0;
+  }
+  step_ += 1;
+  current->pcs.clear();
+  for (int pos = start; pos <= len; pos += 1) {
+    if (!matched) {
+      if (current->pcs.empty()) {
+        // nothing is running: go to where a match could begin
+        if (first_known_) {
+          while (pos < len && !first_bytes_[s[pos]]) {
+            pos += 1;
+          }
+          if (pos == len) {
+            break;
+          }
+        }
+        step_ += 1;
+      }
+      // a match begins only at the start of a character
+      if (pos == len || (s[pos] & 0xC0) != 0x80 || pos == start) {
+        AddThread(current, 0, &initial[0], pos, len);
+      }
+    }
+    if (current->pcs.empty()) {
+      if (matched) {
+        break;
+      }
+      continue;
+    }
+    step_ += 1;
+    next->pcs.clear();
+    for (size_t t = 0; t < current->pcs.size(); t += 1) {
+      int pc = current->pcs[t];
+      int* row = &current->captures[t * capture_count_];
+      const Inst& inst = program_[pc];
+      if (inst.opcode == kOpMatch) {
+        memcpy(captures, row, capture_count_ * sizeof(int));
+        matched = true;
+        break;   // the threads after this one have less priority
+      }
+      if (pos < len &&
+          (inst.opcode == kOpByte ? s[pos] == inst.x
+           : (classes_[inst.x * 32 + s[pos] / 8] & (1 << (s[pos] % 8))))) {
+        AddThread(next, pc + 1, row, pos + 1, len);
+      }
+    }
+    ThreadList* swap = current;
+    current = next;
+    next = swap;
+  }
+  return matched;
+}
@@ -0,0 +1,96 @@
+// Copyright (c) 2011 Revelux Labs, LLC. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+#ifndef SRC_REGEX_H_
+#define SRC_REGEX_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Regex -- a compiled regular expression.
+//  A pattern is compiled into a program for a Pike VM, which runs every
+//  way the pattern can match in step through the text, one byte at a
+//  time. A match costs time in proportion to the text times the pattern,
+//  whatever the pattern is: nothing backtracks. Where several ways match,
+//  the one a backtracking matcher would find first wins, so the result is
+//  the familiar leftmost one, with greedy and lazy repetition. (Patterns
+//  that nest repetitions of things that can match nothing may differ.)
+
+//  The syntax is the common subset: literals, ., [classes] with ranges
+//  and ^ for negation, \d \w \s \D \W \S, ^ and $ for the ends of the
+//  text, groups ( ) and (?: ), |, and the repetitions * + ? {n} {n,}
+//  {n,m}, each of which can be followed by ? to make it lazy. The text is
+//  UTF-8: . and negated classes match whole characters, and a character
+//  of several bytes is repeated as one.
+
+//  Compiled patterns are kept for the life of the process, so a pattern
+//  used in a loop is compiled once.
+
+class Regex {
+ public:
+  virtual ~Regex();
+
+  // Find
+  // The compiled pattern, from the cache or compiled now. If the pattern
+  // is bad, returns NULL and sets error to the reason.
+  static Regex* Find(const char* pattern, int len, const char** error);
+
+  // group_count
+  // The number of capturing groups, not counting the whole match
+  int     group_count() const { return group_count_; }
+
+  // Match
+  // Search the text from start for the leftmost match. The captures hold
+  // the start and end of the match and of each group, or -1 for a group
+  // that did not take part; there must be room for 2 * (group_count + 1).
+  bool    Match(const char* s, int len, int start, int* captures);
+
+ private:
+  struct Inst {
+    int   opcode;
+    int   x;
+    int   y;
+  };
+
+  struct ThreadList {
+    std::vector<int> pcs;         // in order of priority
+    std::vector<int> captures;    // a row for each of pcs
+    std::vector<int> marks;       // by pc: the step that added it
+  };
+
+  Regex();
+
+  // Compile
+  // Compile the pattern, returning NULL or the reason it is bad
+  const char* Compile(const char* pattern, int len);
+
+  // AddThread
+  // Add the thread at pc to the list, following jumps, splits, saves
+  // and assertions, in the order of priority
+  void    AddThread(ThreadList* list, int pc, int* captures, int pos,
+                    int len);
+
+  // FindFirstBytes
+  // Work out which bytes can begin a match, if that is known
+  void    FindFirstBytes();
+
+  std::vector<Inst>   program_;
+  std::vector<unsigned char> classes_;   // 32 bytes for each class
+  int     group_count_;
+  int     capture_count_;
+  bool    first_known_;          // a match must begin with first_bytes_
+  bool    first_bytes_[256];
+
+  // the scratch space of Match
+  ThreadList  lists_[2];
+  int     step_;
+  std::vector<int> stack_;
+
+  static std::map<std::string, Regex*>* cache_;
+
+  friend class RegexParser;
+};
+
+#endif  // SRC_REGEX_H_
@@ -0,0 +1,171 @@
+// Copyright (c) 2011 Revelux Labs, LLC. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+#include "substring_search.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    defined(__SSE2__)
+#define TILTON_X86_SIMD 1
+#include <emmintrin.h>
+#endif
+
+SubstringSearch::SubstringSearch() {
+  for (int i = 0; i < 256; i += 1) {
+    buckets_[i] = -1;
+  }
+  matchable_ = 0;
+  shortest_ = 0;
+  first_byte_count_ = 0;
+}
+
+SubstringSearch::~SubstringSearch() {
+}
+
+void SubstringSearch::AddNeedle(const char* s, int len) {
+  Needle needle = { s, len, -1 };
+  int number = static_cast<int>(needles_.size());
+  needles_.push_back(needle);
+  if (len <= 0) {
+    return;
+  }
+  if (matchable_ == 0 || len < shortest_) {
+    shortest_ = len;
+  }
+  matchable_ += 1;
+
+  // keep each bucket in needle order, so the first match is the lowest
+  unsigned char first = static_cast<unsigned char>(s[0]);
+  if (buckets_[first] < 0) {
+    buckets_[first] = number;
+    if (first_byte_count_ < kMaxFilterBytes) {
+      first_bytes_[first_byte_count_] = first;
+    }
+    first_byte_count_ += 1;
+  } else {
+    int k = buckets_[first];
+    while (needles_[k].next >= 0) {
+      k = needles_[k].next;
+    }
+    needles_[k].next = number;
+  }
+}
+
+int SubstringSearch::MatchAt(const char* text, int len, int i) const {
+  int k = buckets_[static_cast<unsigned char>(text[i])];
+  for (; k >= 0; k = needles_[k].next) {
+    const Needle& needle = needles_[k];
+    if (needle.length <= len - i &&
+        memcmp(text + i, needle.string, needle.length) == 0) {
+      return k;
+    }
+  }
+  return -1;
+}
+
+#ifdef TILTON_X86_SIMD
+
+// The bytes of a block that equal any of the filter bytes, as a bit mask.
+static inline int FilterBlock(const char* s, const __m128i* filter,
+                              int count) {
+  __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+  __m128i m = _mm_cmpeq_epi8(v, filter[0]);
+  for (int f = 1; f < count; f += 1) {
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, filter[f]));
+  }
+  return _mm_movemask_epi8(m);
+}
+
+#endif  // TILTON_X86_SIMD
+
+int SubstringSearch::NextCandidate(const char* text, int i, int len) const {
+  if (first_byte_count_ == 1) {
+    const void* p = memchr(text + i, first_bytes_[0], len - i);
+    return p ? static_cast<int>(static_cast<const char*>(p) - text) : len;
+  }
+#ifdef TILTON_X86_SIMD
+  if (first_byte_count_ <= kMaxFilterBytes) {
+    __m128i filter[kMaxFilterBytes];
+    for (int f = 0; f < first_byte_count_; f += 1) {
+      filter[f] = _mm_set1_epi8(static_cast<char>(first_bytes_[f]));
+    }
+    for (; i + 16 <= len; i += 16) {
+      int mask = FilterBlock(text + i, filter, first_byte_count_);
+      if (mask) {
+        return i + __builtin_ctz(mask);
+      }
+    }
+  }
+#endif
+  for (; i < len; i += 1) {
+    if (buckets_[static_cast<unsigned char>(text[i])] >= 0) {
+      return i;
+    }
+  }
+  return len;
+}
+
+int SubstringSearch::PreviousCandidate(const char* text, int i) const {
+#ifdef TILTON_X86_SIMD
+  if (first_byte_count_ <= kMaxFilterBytes) {
+    __m128i filter[kMaxFilterBytes];
+    for (int f = 0; f < first_byte_count_; f += 1) {
+      filter[f] = _mm_set1_epi8(static_cast<char>(first_bytes_[f]));
+    }
+    for (; i >= 15; i -= 16) {
+      int mask = FilterBlock(text + i - 15, filter, first_byte_count_);
+      if (mask) {
+        return i - 15 + 31 - __builtin_clz(mask);
+      }
+    }
+  }
+#endif
+  for (; i >= 0; i -= 1) {
+    if (buckets_[static_cast<unsigned char>(text[i])] >= 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+int SubstringSearch::FindFirst(const char* text, int len, int* needle) const {
+  if (matchable_ == 0 || len < shortest_) {
+    return -1;
+  }
+  if (matchable_ == 1) {
+    int k = buckets_[first_bytes_[0]];
+    const void* p = memmem(text, len, needles_[k].string, needles_[k].length);
+    if (p == NULL) {
+      return -1;
+    }
+    *needle = k;
+    return static_cast<int>(static_cast<const char*>(p) - text);
+  }
+  int last = len - shortest_;
+  for (int i = NextCandidate(text, 0, len); i <= last;
+       i = NextCandidate(text, i + 1, len)) {
+    int k = MatchAt(text, len, i);
+    if (k >= 0) {
+      *needle = k;
+      return i;
+    }
+  }
+  return -1;
+}
+
+int SubstringSearch::FindLast(const char* text, int len, int* needle) const {
+  if (matchable_ == 0 || len < shortest_) {
+    return -1;
+  }
+  for (int i = PreviousCandidate(text, len - shortest_); i >= 0;
+       i = PreviousCandidate(text, i - 1)) {
+    int k = MatchAt(text, len, i);
+    if (k >= 0) {
+      *needle = k;
+      return i;
+    }
+  }
+  return -1;
+}
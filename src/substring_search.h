@@ -0,0 +1,69 @@
+// Copyright (c) 2011 Revelux Labs, LLC. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+#ifndef SRC_SUBSTRING_SEARCH_H_
+#define SRC_SUBSTRING_SEARCH_H_
+
+#include <vector>
+
+// SubstringSearch -- finds the earliest or latest of several needles.
+//  The needles are bucketed by their first byte, so one pass over the text
+//  finds a match of any of them. The pass looks only at positions holding
+//  one of the first bytes, which it finds 16 at a time with SSE2 when there
+//  are at most four of them, and compares just the needles of that bucket.
+//  A single needle is found with memmem.
+
+//  The needles are not copied, so they must outlive the search.
+
+class SubstringSearch {
+ public:
+  SubstringSearch();
+  virtual ~SubstringSearch();
+
+  // AddNeedle
+  // Add a needle. Needles are numbered from 0 in the order they are added.
+  // An empty needle never matches.
+  void    AddNeedle(const char* s, int len);
+
+  // FindFirst
+  // Returns the index of the earliest match in the text, or -1. The number
+  // of the needle found there is stored in needle; if several match at
+  // that index, the lowest number wins.
+  int     FindFirst(const char* text, int len, int* needle) const;
+
+  // FindLast
+  // Returns the index of the latest match in the text, or -1, setting
+  // needle as FindFirst does.
+  int     FindLast(const char* text, int len, int* needle) const;
+
+ private:
+  struct Needle {
+    const char* string;
+    int         length;
+    int         next;     // the next needle in the same bucket, or -1
+  };
+
+  // MatchAt
+  // Returns the lowest numbered needle that matches at index i, or -1
+  int     MatchAt(const char* text, int len, int i) const;
+
+  // NextCandidate
+  // Returns the first index from i that holds a first byte, or len
+  int     NextCandidate(const char* text, int i, int len) const;
+
+  // PreviousCandidate
+  // Returns the last index up to i that holds a first byte, or -1
+  int     PreviousCandidate(const char* text, int i) const;
+
+  static const int kMaxFilterBytes = 4;
+
+  std::vector<Needle> needles_;
+  int     buckets_[256];        // the first needle for each first byte
+  int     matchable_;           // the number of needles that are not empty
+  int     shortest_;            // the length of the shortest of those
+  int     first_byte_count_;    // the number of distinct first bytes
+  unsigned char first_bytes_[kMaxFilterBytes];
+};
+
+#endif  // SRC_SUBSTRING_SEARCH_H_
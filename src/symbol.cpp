@@ -0,0 +1,33 @@
+// Copyright (c) 2011 Revelux Labs, LLC. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+#include "symbol.h"
+
+#include <string.h>
+
+#include "macro.h"
+#include "text.h"
+
+Symbol::Symbol(Text* name, uint32 hash) {
+    builtin_ = NULL;
+    hash_ = hash;
+    link_ = NULL;
+    macro_ = NULL;
+    name_length_ = name->length_;
+    name_ = new char[name_length_ + 1];
+    memmove(name_, name->string_, name_length_);
+    name_[name_length_] = '\0';
+    prior_ = NULL;
+    references_ = 0;
+}
+
+Symbol::~Symbol() {
+    delete macro_;
+    delete[] name_;
+}
+
+bool Symbol::IsNameEqual(Text* t) {
+    return name_length_ == t->length_ &&
+           memcmp(name_, t->string_, name_length_) == 0;
+}
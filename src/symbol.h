@@ -0,0 +1,42 @@
+// Copyright (c) 2011 Revelux Labs, LLC. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+#ifndef SRC_SYMBOL_H_
+#define SRC_SYMBOL_H_
+
+#include "tilton.h"
+
+class Macro;
+class Text;
+
+// Symbol -- an interned name.
+//  Every name that is defined, registered as a builtin, or called from a
+//  program that is kept has one Symbol, made the first time the name is
+//  seen. A Symbol points to the builtin and to the macro of that name,
+//  either of which may be missing. A call prefers the builtin; get, set,
+//  first and the like see only the macro.
+
+//  Each compiled call that holds on to a Symbol counts in its references_.
+//  The table frees a Symbol once it has no builtin, no macro and no
+//  references, so names that are made and deleted do not pile up.
+
+class Symbol {
+ public:
+  Symbol(Text* name, uint32 hash);
+  virtual ~Symbol();
+
+  // IsNameEqual
+  bool    IsNameEqual(Text* t);
+
+  Builtin  builtin_;
+  uint32   hash_;
+  Symbol*  link_;       // the next symbol interned
+  Macro*   macro_;
+  char*    name_;
+  int      name_length_;
+  Symbol*  prior_;      // the symbol interned before
+  int      references_; // the compiled calls that hold the symbol
+};
+
+#endif  // SRC_SYMBOL_H_
@@ -7,9 +7,20 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include <string>
 
 #include "tilton.h"
+#include "byte_scan.h"
 #include "macro.h"
+#include "mapped_file.h"
+#include "transform.h"
 
 Text::Text() {
     InitializeText(NULL, 0);
@@ -31,9 +42,25 @@ Text::Text(const char* s, int len) {
 }
 
 
+Text::Text(const char* s, int len, bool borrowed) {
+    if (borrowed) {
+        InitializeText(NULL, 0);
+        string_ = const_cast<char*>(s);
+        length_ = len;
+        borrowed_ = true;
+        ascii_ = len ? -1 : 1;
+    } else {
+        InitializeText(s, len);
+    }
+}
+
+
 Text::Text(Text* t) {
     if (t) {
         InitializeText(t->string_, t->length_);
+        ascii_ = t->ascii_;
+        number_ = t->number_;
+        number_known_ = t->number_known_;
     } else {
         InitializeText(NULL, 0);
     }
@@ -59,8 +86,11 @@ Text::Text(Macro* m) {
 }
 
 Text::~Text() {
-    delete this->string_;
+    if (!borrowed_) {
+        delete this->string_;
+    }
     delete this->name_;
+    delete[] utf_index_;
 }
 
 
@@ -68,7 +98,10 @@ void Text::AddToString(int c) {
     CheckLengthAndIncrease(1);
     string_[length_] = static_cast<char>(c);
     length_ += 1;
-    my_hash_ = 0;
+    if (c & 0x80) {
+        ascii_ = 0;
+    }
+    Changed();
 }
 
 
@@ -79,7 +112,10 @@ void Text::AddToString(int c, int n) {
         length_ += 1;
         n -= 1;
     }
-    my_hash_ = 0;
+    if (c & 0x80) {
+        ascii_ = 0;
+    }
+    Changed();
 }
 
 
@@ -92,35 +128,87 @@ void Text::AddToString(const char* s) {
 
 void Text::AddToString(const char* s, int len) {
     if (s && len) {
-        CheckLengthAndIncrease(len);
-        memmove(&string_[length_], s, len);
-        length_ += len;
-        my_hash_ = 0;
+        if (ascii_ == 1 && !ByteScan::IsAscii(s, len)) {
+            ascii_ = 0;
+        }
+        Append(s, len);
     }
 }
 
 
 void Text::AddToString(Text* t) {
-    if (t) {
-        AddToString(t->string_, t->length_);
+    if (t && t->string_ && t->length_) {
+        if (ascii_ == 1 && t->ascii_ != 1) {
+            ascii_ = t->ascii_ == 0 ||
+                     !ByteScan::IsAscii(t->string_, t->length_) ? 0 : 1;
+        }
+        Append(t->string_, t->length_);
     }
 }
 
 
+void Text::Append(const char* s, int len) {
+    CheckLengthAndIncrease(len);
+    memmove(&string_[length_], s, len);
+    length_ += len;
+    Changed();
+}
+
+
+void Text::Changed() {
+    my_hash_ = 0;
+    number_known_ = false;
+    utf_length_ = -1;
+    if (utf_index_) {
+        delete[] utf_index_;
+        utf_index_ = NULL;
+    }
+}
+
+
+void Text::Reserve(int len) {
+    CheckLengthAndIncrease(len);
+}
+
+
+// The digits are produced two at a time from the right into a buffer
+// that holds the longest number, and appended in one step.
 void Text::AddNumberToString(number n) {
-    number d;
-    if (n != kNAN) {
-        if (n < 0) {
-            AddToString('-');
-            n = -n;
-        }
-        d = n / 10;
-        if (d > 0) {
-            AddNumberToString(d);
-        }
-        AddToString(static_cast<int>((n % 10) + '0'));
-        my_hash_ = 0;
+    static const char kDigitPairs[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233"
+        "34353637383940414243444546474849505152535455565758596061626364656667"
+        "6869707172737475767778798081828384858687888990919293949596979899";
+    char buffer[24];
+    char* end = buffer + sizeof(buffer);
+    char* p = end;
+    unsigned long u;
+
+    if (n == kNAN) {
+        return;
     }
+    u = n < 0 ? 0UL - static_cast<unsigned long>(n)
+              : static_cast<unsigned long>(n);
+    while (u >= 100) {
+        int pair = static_cast<int>(u % 100) * 2;
+        u /= 100;
+        p -= 2;
+        p[0] = kDigitPairs[pair];
+        p[1] = kDigitPairs[pair + 1];
+    }
+    if (u >= 10) {
+        int pair = static_cast<int>(u) * 2;
+        p -= 2;
+        p[0] = kDigitPairs[pair];
+        p[1] = kDigitPairs[pair + 1];
+    } else {
+        p -= 1;
+        p[0] = static_cast<char>('0' + u);
+    }
+    if (n < 0) {
+        p -= 1;
+        p[0] = '-';
+    }
+    Append(p, static_cast<int>(end - p));
 }
 
 //  If the requested amount does not fit within the allocated max length,
@@ -135,8 +223,13 @@ void Text::CheckLengthAndIncrease(int len) {
             newMaxLength = req;
         }
         char* newString = new char[newMaxLength];
-        memmove(newString, string_, max_length_);
-        delete string_;
+        if (length_) {
+            memmove(newString, string_, length_);
+        }
+        if (!borrowed_) {
+            delete string_;
+        }
+        borrowed_ = false;
         string_ = newString;
         max_length_ = newMaxLength;
     }
@@ -151,6 +244,14 @@ int Text::GetCharacter(int index) {
 }
 
 number Text::getNumber() {
+  if (!number_known_) {
+    number_ = ParseNumber();
+    number_known_ = true;
+  }
+  return number_;
+}
+
+number Text::ParseNumber() {
   int c;
   int i = 0;
   bool sign = false;
@@ -220,6 +321,11 @@ void Text::InitializeText(const char* s, int len) {
     name_ = NULL;
     length_ = name_length_ = 0;
     my_hash_ = 0;
+    number_known_ = false;
+    borrowed_ = false;
+    utf_length_ = -1;
+    utf_index_ = NULL;
+    utf_indexed_ = utf_scanned_ = 0;
     max_length_ = len;
     if (len == 0) {
         string_ = NULL;
@@ -230,14 +336,24 @@ void Text::InitializeText(const char* s, int len) {
             length_ = len;
         }
     }
+    ascii_ = length_ ? -1 : 1;
 }
 
 
 void Text::ReadStdInput() {
+    static MappedFile* input = NULL;
     char buffer[10240];
     int len;
     length_ = 0;
-    my_hash_ = static_cast<int>(0);
+    ascii_ = 1;
+    Changed();
+    if (input == NULL) {
+        input = new MappedFile();
+        if (input->Map(fileno(stdin))) {
+            Borrow(input->data(), input->length());
+            return;
+        }
+    }
     for (;;) {
         len = static_cast<int>(fread(buffer, sizeof(char),
                                sizeof(buffer), stdin));
@@ -249,6 +365,20 @@ void Text::ReadStdInput() {
 }
 
 
+int Text::ReadStdInputChunk() {
+    char buffer[10240];
+    ssize_t len;
+    do {
+        len = read(fileno(stdin), buffer, sizeof(buffer));
+    } while (len < 0 && errno == EINTR);
+    if (len <= 0) {
+        return 0;
+    }
+    AddToString(buffer, static_cast<int>(len));
+    return static_cast<int>(len);
+}
+
+
 bool Text::IsEqual(Text* t) {
     int i;
     if (length_ != t->length_) {
@@ -273,25 +403,45 @@ bool Text::lt(Text* t) {
 }
 
 bool Text::ltNum(Text* t) {
-    int first, second;
-
-    first = atoi(this->string_);
-    second = atoi(t->string_);
-    return first < second;
+    // short runs of digits are the numbers that getNumber remembers
+    if (length_ > 0 && length_ <= kShortNumber &&
+        t->length_ > 0 && t->length_ <= kShortNumber) {
+        return getNumber() < t->getNumber();
+    }
+    return digitValue(string_, length_) < digitValue(t->string_, t->length_);
 }
 
 bool Text::ltStr(Text* t) {
-    // original lt
-    int len = t->length_;
-    if (len > length_) {
-        len = length_;
+    return ltStr(string_, length_, t->string_, t->length_);
+}
+
+bool Text::allDigits(const char* s, int len) {
+    for (int i = 0; i < len; i += 1) {
+        if (!isDigit(s[i] - '0')) {
+            return false;
+        }
     }
+    return true;
+}
+
+// A run of digits too long for a number wraps around, as it always has.
+number Text::digitValue(const char* s, int len) {
+    unsigned long value = 0;
     for (int i = 0; i < len; i += 1) {
-        if (string_[i] != t->string_[i]) {
-            return (string_[i] < t->string_[i]);
+        value = value * 10 + (s[i] - '0');
+    }
+    return static_cast<number>(value);
+}
+
+bool Text::ltStr(const char* s, int len, const char* t, int tlen) {
+    // original lt
+    int shorter = tlen > len ? len : tlen;
+    for (int i = 0; i < shorter; i += 1) {
+        if (s[i] != t[i]) {
+            return (s[i] < t[i]);
         }
     }
-    return len != t->length_;
+    return shorter != tlen;
 }
 
 
@@ -312,10 +462,17 @@ bool Text::ReadFromFile(Text* filename) {
   memmove(buffer, name_, name_length_);
   buffer[filename->length_] = 0;
 
-  my_hash_ = 0;
   length_ = 0;
+  ascii_ = 1;
+  Changed();
   fp = fopen(buffer, "rb");
   if (fp) {
+    // a regular file is read into room for all of it
+    struct stat st;
+    if (fstat(fileno(fp), &st) == 0 && S_ISREG(st.st_mode) &&
+        st.st_size < INT_MAX / 2) {
+      Reserve(static_cast<int>(st.st_size));
+    }
     for (;;) {
       len = static_cast<int>(fread(buffer, sizeof(char),
                              sizeof(buffer), fp));
@@ -332,19 +489,122 @@ bool Text::ReadFromFile(Text* filename) {
 }
 
 
+// Only the bytes asked for are read, straight into the string. A file that
+// cannot seek, such as a pipe, is read up to the offset and dropped.
+bool Text::AddFromFile(Text* filename, number offset, number length) {
+  char* path = new char[filename->length_ + 1];
+  memmove(path, filename->string_, filename->length_);
+  path[filename->length_] = 0;
+  int fd = open(path, O_RDONLY);
+  delete[] path;
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  bool regular = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+  if (regular) {
+    number rest = offset < st.st_size ? st.st_size - offset : 0;
+    if (length < 0 || length > rest) {
+      length = rest;
+    }
+  }
+  if (length > INT_MAX - length_) {
+    close(fd);
+    return false;
+  }
+  number skipped = 0;
+  int start = length_;
+  bool ok = true;
+  while (length != 0) {
+    // a regular file is read into room for all of it; anything else in
+    // chunks, the bytes before the offset being read and written over
+    int room = 10240;
+    if (regular || (length > 0 && length < room)) {
+      room = static_cast<int>(length);
+    }
+    CheckLengthAndIncrease(room);
+    ssize_t n;
+    if (regular) {
+      n = pread(fd, &string_[length_], room, offset + (length_ - start));
+    } else {
+      n = read(fd, &string_[length_], room);
+    }
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      ok = n == 0;
+      break;
+    }
+    if (!regular && skipped < offset) {
+      number drop = offset - skipped < n ? offset - skipped : n;
+      skipped += drop;
+      memmove(&string_[length_], &string_[length_ + drop], n - drop);
+      n -= static_cast<int>(drop);
+    }
+    if (ascii_ == 1 && !ByteScan::IsAscii(&string_[length_], n)) {
+      ascii_ = 0;
+    }
+    length_ += static_cast<int>(n);
+    if (length > 0) {
+      length -= n;
+    }
+  }
+  close(fd);
+  Changed();
+  return ok;
+}
+
+
 void Text::set_string(Text* t) {
-    my_hash_ = 0;
+    Changed();
     if (t && t->length_) {
+        ascii_ = t->ascii_;
         length_ = t->length_;
         if (length_ > max_length_) {
-            delete string_;
+            if (!borrowed_) {
+                delete string_;
+            }
+            borrowed_ = false;
             string_ = new char[length_];
             max_length_ = length_;
         }
         memmove(string_, t->string_, length_);
     } else {
         length_ = 0;
+        ascii_ = 1;
+    }
+}
+
+
+void Text::set_string(const char* s, int len) {
+    Changed();
+    if (len > max_length_ || (borrowed_ && len > 0)) {
+        if (!borrowed_) {
+            delete string_;
+        }
+        borrowed_ = false;
+        string_ = new char[len];
+        max_length_ = len;
+    }
+    if (len) {
+        memmove(string_, s, len);
+    }
+    length_ = len;
+    ascii_ = len ? -1 : 1;
+}
+
+
+void Text::Borrow(const char* s, int len) {
+    Changed();
+    if (!borrowed_) {
+        delete string_;
     }
+    borrowed_ = true;
+    string_ = const_cast<char*>(s);
+    length_ = len;
+    max_length_ = 0;
+    ascii_ = len ? -1 : 1;
 }
 
 
@@ -367,7 +627,15 @@ void Text::set_name(Text* t) {
 
 
 void Text::substr(int start, int len) {
-    memmove(string_, &string_[start], len);
+    Changed();
+    if (ascii_ == 0) {
+        ascii_ = -1;
+    }
+    if (borrowed_) {
+        string_ += start;
+    } else {
+        memmove(string_, &string_[start], len);
+    }
     length_ = len;
 }
 
@@ -376,106 +644,137 @@ Text* Text::RemoveFromString(int index) {
     if (index >= 0 && index < length_) {
         int len = length_ - index;
         length_ = index;
-        my_hash_ = 0;
-        return new Text(&string_[index], len);
+        Changed();
+        Text* t = new Text(&string_[index], len);
+        if (ascii_ == 1) {
+            t->ascii_ = 1;
+        } else {
+            ascii_ = -1;
+        }
+        return t;
     } else {
         return new Text();
     }
 }
 
+void Text::RemoveFromFront(int count) {
+    if (count >= length_) {
+        length_ = 0;
+    } else if (count > 0 && borrowed_) {
+        string_ += count;
+        length_ -= count;
+    } else if (count > 0) {
+        memmove(string_, &string_[count], length_ - count);
+        length_ -= count;
+    }
+    if (ascii_ == 0) {
+        ascii_ = length_ ? -1 : 1;
+    }
+    Changed();
+}
+
 // trim is like append, except that it trims leading, trailing spaces, and
 // reduces runs of whitespace to single space
 void Text::RemoveSpacesAddToString(Text* t) {
-    char* s = t->string_;
-    int l = t->length_;
-    int i = 0;
-    bool b = false;
-    for (;;) {
-        while (s[i] > ' ') {
-            AddToString(s[i]);
-            b = true;
-            i += 1;
-            if (i >= l) {
-                return;
-            }
-        }
-        do {
-            i += 1;
-            if (i >= l) {
-                return;
-            }
-        } while (s[i] <= ' ');
-        if (b) {
-            AddToString(' ');
-        }
+    if (t) {
+        Transform::Trim().Apply(t->string_, t->length_, this);
     }
 }
 
 
 int Text::utfLength() {
-  int index = 0;
-  int num = 0;
-  while (index < length_) {
-    index = AdvanceToNextChar(index);
-    num += 1;
+  if (IsAscii()) {
+    return length_;
+  }
+  if (utf_length_ < 0) {
+    utf_length_ = ByteScan::CountCharacters(string_, length_);
   }
-  return num;
+  return utf_length_;
 }
 
 int Text::AdvanceToNextChar(int i) {
-  int c;
-  c = string_[i] & 0xFF;
-  i += 1;
-  if (c >= 0xC0) {
-    if (c < 0xE0) {  // 2-byte form
-      // <= jr 18Sep11
-      if ((i + 1) <= length_ && ((string_[i] & 0xC0) == 0x80)) {
-        i += 1;
-      }
-    } else if (c < 0xF0) {  // 3-byte form
-      // <= jr 18Sep11
-      if ((i + 2) <= length_ &&
-          ((string_[i]     & 0xC0) == 0x80) &&
-          ((string_[i + 1] & 0xC0) == 0x80)) {
-        i += 2;
-      }
-    } else {  // 4-byte form
-      // <= jr 18Sep11
-      if ((i + 3) <= length_ &&
-          ((string_[i]     & 0xC0) == 0x80) &&
-          ((string_[i + 1] & 0xC0) == 0x80) &&
-          ((string_[i + 2] & 0xC0) == 0x80)) {
-        i += 3;
-      }
+  return ByteScan::NextCharacter(string_, length_, i);
+}
+
+bool Text::IsAscii() {
+  if (ascii_ < 0) {
+    ascii_ = ByteScan::IsAscii(string_, length_) ? 1 : 0;
+  }
+  return ascii_ == 1;
+}
+
+// Runs of ASCII are skipped a block at a time; only the other characters
+// need to be decoded one by one.
+void Text::ExtendUtfIndex(int n) {
+  if (!utf_index_) {
+    utf_index_ = new int[length_ / kUtfSample + 1];
+    utf_indexed_ = utf_scanned_ = 0;
+  }
+  while (utf_indexed_ < n && utf_scanned_ < length_) {
+    int into = utf_indexed_ % kUtfSample;
+    if (into == 0) {
+      utf_index_[utf_indexed_ / kUtfSample] = utf_scanned_;
+    }
+    int run = length_ - utf_scanned_;
+    if (run > kUtfSample - into) {
+      run = kUtfSample - into;
+    }
+    if (run > n - utf_indexed_) {
+      run = n - utf_indexed_;
+    }
+    run = ByteScan::FindNonAscii(string_ + utf_scanned_, run);
+    if (run) {
+      utf_scanned_ += run;
+      utf_indexed_ += run;
+    } else {
+      utf_scanned_ = AdvanceToNextChar(utf_scanned_);
+      utf_indexed_ += 1;
     }
   }
+  if (utf_scanned_ == length_) {
+    utf_length_ = utf_indexed_;
+  }
+}
+
+int Text::utfOffset(int n) {
+  if (IsAscii()) {
+    return n <= length_ ? n : -1;
+  }
+  if (!utf_index_ || n > utf_indexed_) {
+    ExtendUtfIndex(n);
+  }
+  if (n >= utf_indexed_) {
+    return n == utf_indexed_ ? utf_scanned_ : -1;
+  }
+  int i = utf_index_[n / kUtfSample];
+  for (n %= kUtfSample; n > 0; n -= 1) {
+    i = AdvanceToNextChar(i);
+  }
   return i;
 }
 
 
 Text* Text::utfSubstr(const int start, int len) {
-  int i = 0;
-  int j;
   Text* t;
-  
+
   // skip start UTF-8 chars in string
   // start -1 fixes off by one bug with position -- jr 18Sep11
-  for (j=0; j < start - 1 ; j++) {
-    if (i >= length_) {
-      return NULL;
-    }
-    i = AdvanceToNextChar(i);
+  int skip = start > 1 ? start - 1 : 0;
+  int i = utfOffset(skip);
+  if (i < 0) {
+    return NULL;
   }
-  
-  // make a new string
-  t = new Text(length_ - i);
-  
-  // and copy UTF-8 chars
-  while (len && i < length_) {
-    j = AdvanceToNextChar(i);
-    t->AddToString(&string_[i], j-i);
-    i = j;
-    len -= 1;
+
+  // a character is at least a byte, so a len of length_ takes the rest
+  int j = len < 0 || len >= length_ ? -1 : utfOffset(skip + len);
+  if (j < 0) {
+    j = length_;
+  }
+
+  // make a new string of the characters
+  t = new Text(&string_[i], j - i);
+  if (ascii_ == 1) {
+    t->ascii_ = 1;
   }
   return t;
 }
@@ -483,10 +782,8 @@ Text* Text::utfSubstr(const int start, int len) {
 
 bool Text::WriteToFile(Text* filename) {
     FILE *fp;
-    char fname[256];
-    memmove(fname, filename->string_, filename->length_);
-    fname[filename->length_] = 0;
-    fp = fopen(fname, "wb");
+    std::string fname(filename->string_, filename->length_);
+    fp = fopen(fname.c_str(), "wb");
     if (fp) {
         fwrite(string_, sizeof(char), length_, fp);
         fclose(fp);
@@ -497,64 +794,56 @@ bool Text::WriteToFile(Text* filename) {
 }
 
 
-// hash is based on work by Bob Jenkins, 1996.  bob_jenkins@burtleburtle.net.
-// See http://burtleburtle.net/bob/hash/evahash.html
+// hash reads the string a word at a time and mixes each word with a
+// multiply and a rotate, then finishes with an avalanche so that every bit
+// of the result depends on every bit of the input. The seed is chosen once
+// per process so that a set of names that collides in one run does not
+// collide in the next.
 
+static uint64 hash_seed = 0;
 
-#define mix(a, b, c) { \
-  a -= b; a -= c; a ^= (c >> 13); \
-  b -= c; b -= a; b ^= (a << 8);  \
-  c -= a; c -= b; c ^= (b >> 13); \
-  a -= b; b -= a; a ^= (c >> 12); \
-  b -= c; b -= a; b ^= (a << 16); \
-  c -= a; c -= b; c ^= (b >> 5);  \
-  a -= b; a -= c; a ^= (c >> 3);  \
-  b -= c; b -= a; b ^= (a << 10); \
-  c -= a; c -= b; c ^= (b >> 15); \
+static inline uint64 HashMix(uint64 h, uint64 w) {
+    h ^= w * 0x87C37B91114253D5ULL;
+    h = (h << 31) | (h >> 33);
+    return h * 0x4CF5AD432745937FULL;
+}
+
+static uint64 HashSeed() {
+    if (hash_seed == 0) {
+        uint64 x = static_cast<uint64>(time(NULL)) ^
+                   (static_cast<uint64>(getpid()) << 32) ^
+                   static_cast<uint64>(reinterpret_cast<size_t>(&x));
+        hash_seed = HashMix(x, 0x9E3779B97F4A7C15ULL) | 1;
+    }
+    return hash_seed;
+}
+
+uint32 Text::Hash(const char* s, int len) {
+    uint64 h = HashSeed() ^ static_cast<uint64>(len);
+    uint64 w;
+    while (len >= 8) {
+        memcpy(&w, s, 8);
+        h = HashMix(h, w);
+        s += 8;
+        len -= 8;
+    }
+    if (len > 0) {
+        w = 0;
+        memcpy(&w, s, len);
+        h = HashMix(h, w);
+    }
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return static_cast<uint32>(h);
 }
 
 uint32 Text::Hash() {
     if (my_hash_) {
         return my_hash_;  // If we have already memoized the hash, use it.
     }
-    register uint32  a = 0;
-    register uint32  b = 0xDEADBEAD;
-    register uint32  c = 0xCAFEB00B;
-    register uint8* k = reinterpret_cast<uint8*>(string_);
-    register int  len = length_;
-
-    while (len >= 12) {
-        a += static_cast<uint32>(k[0]) +
-             (static_cast<uint32>(k[1] << 8)) +
-             (static_cast<uint32>(k[2] << 16)) +
-             (static_cast<uint32>(k[3] <<24));
-        b += static_cast<uint32>(k[4]) +
-             (static_cast<uint32>(k[5] << 8)) +
-             (static_cast<uint32>(k[6] << 16)) +
-             (static_cast<uint32>(k[7] <<24));
-        c += static_cast<uint32>(k[8]) +
-             (static_cast<uint32>(k[9] << 8)) +
-             (static_cast<uint32>(k[10]<< 16)) +
-             (static_cast<uint32>(k[11]<<24));
-        mix(a, b, c);
-        k += 12;
-        len -= 12;
-    }
-    c += length_;
-    switch (len) {
-    case 11: c += static_cast<uint32>(k[10] << 24);
-    case 10: c += static_cast<uint32>(k[9]  << 16);
-    case 9:  c += static_cast<uint32>(k[8]  <<  8);
-    case 8:  b += static_cast<uint32>(k[7]  << 24);
-    case 7:  b += static_cast<uint32>(k[6]  << 16);
-    case 6:  b += static_cast<uint32>(k[5]  <<  8);
-    case 5:  b += static_cast<uint32>(k[4]);
-    case 4:  a += static_cast<uint32>(k[3]  << 24);
-    case 3:  a += static_cast<uint32>(k[2]  << 16);
-    case 2:  a += static_cast<uint32>(k[1]  <<  8);
-    case 1:  a += static_cast<uint32>(k[0]);
-    }
-    mix(a, b, c);
-    my_hash_ = c;
-    return c;
+    my_hash_ = Hash(string_, length_);
+    return my_hash_;
 }
@@ -24,12 +24,24 @@ class Macro;
 //  character. So while expecting UTF-8 encoded strings, it will usually
 //  do the right thing with Latin-1 and similar encodings.
 
+//  A Text knows when its string is all ASCII, and then a character is a
+//  byte. Otherwise utfLength counts the characters once, and utfSubstr
+//  keeps an index of where every kUtfSample-th character begins, extended
+//  as far as it has been asked to go, so that later calls need not decode
+//  from the front. Any change to the string forgets the count and the
+//  index, as it forgets the hash.
+
+//  A Text can borrow its string from memory that outlives it, such as the
+//  source of a Program. A borrowed string is never written: the first
+//  change that needs room copies it.
+
 class Text {
  public:
   Text();
   explicit Text(int len);
   explicit Text(const char* s);
   Text(const char* s, int len);
+  Text(const char* s, int len, bool borrowed);
   explicit Text(Text* t);
   explicit Text(Macro* t);
   virtual ~Text();
@@ -41,6 +53,9 @@ class Text {
   void    AddToString(const char* s, int len);
   void    AddToString(Text* t);
   
+  // makes room for len more bytes, so appending them does not reallocate
+  void    Reserve(int len);
+
   // appends a number to the string wrapped by Text
   void    AddNumberToString(number);
 
@@ -50,15 +65,21 @@ class Text {
   // retrieve a character from string
   int     GetCharacter(int index);
   
-  // retrieve a number from string
+  // retrieve a number from string, which is parsed once until it changes
   number  getNumber();
   
   // calculate a hash for a string
   uint32  Hash();
+  static uint32 Hash(const char* s, int len);
   
-  // Read from stdin and append to string
+  // Read from stdin into string. A regular file is mapped and borrowed
+  // instead, and stays mapped for the rest of the run.
   void    ReadStdInput();
 
+  // Read what stdin has available, up to 10K, and append to string.
+  // Returns the number of bytes read, 0 at the end of the input.
+  int     ReadStdInputChunk();
+
   bool    IsEqual(Text* t);
   
   bool    lt(Text* t);
@@ -68,9 +89,17 @@ class Text {
   
   // read the file in 10K chunks and add to string_
   bool    ReadFromFile(Text* t);
+
+  // read length bytes of the file from offset, or up to its end if length
+  // is negative, and add them to string_
+  bool    AddFromFile(Text* t, number offset, number length);
   
   // setter for string_
   void    set_string(Text* t);
+  void    set_string(const char* s, int len);
+
+  // borrow len bytes at s as the string; they must outlive the text
+  void    Borrow(const char* s, int len);
   
   // setter for name_
   void    set_name(const char* s);
@@ -79,11 +108,16 @@ class Text {
   
   void    substr(int start, int len);
   Text*   RemoveFromString(int index);
+
+  // removes the first count bytes of string_
+  void    RemoveFromFront(int count);
   
   // trims whitespace before appending to string_
   void    RemoveSpacesAddToString(Text* t);
   
+  // the number of UTF-8 characters
   int     utfLength();
+  // a new Text of len characters, skipping start - 1 characters
   Text*   utfSubstr(int start, int len);
   
   // writes string_ to a file
@@ -91,9 +125,17 @@ class Text {
 
   // Tests to see if a string is all digits
   bool    allDigits() {
-    const char*   cset = "1234567890";
-    return this->length_ == strspn(this->string_, cset);
+    return allDigits(string_, length_);
   }
+  static bool allDigits(const char* s, int len);
+
+  // digitValue
+  // The value of a run of digits, as lt compares it
+  static number digitValue(const char* s, int len);
+
+  // ltStr
+  // less than for strings, as lt compares those that are not both digits
+  static bool ltStr(const char* s, int len, const char* t, int tlen);
 
   // Tests to see if the arg is a digit
   static bool isDigit(int arg_number) {
@@ -130,6 +172,33 @@ class Text {
   void    CheckLengthAndIncrease(int len);
   void    InitializeText(const char* s, int len);
 
+  // Append
+  // Append bytes whose effect on ascii_ has been accounted for
+  void    Append(const char* s, int len);
+
+  // Changed
+  // Forget what was computed from the string: the hash, the number and
+  // the UTF-8 index
+  void    Changed();
+
+  // ParseNumber
+  // The number in the string, or kNAN
+  number  ParseNumber();
+
+  // IsAscii
+  // Tests to determine if every byte is ASCII, remembering the answer
+  bool    IsAscii();
+
+  // utfOffset
+  // The byte index of character n, or -1 if there are fewer characters.
+  // n can be the number of characters, which ends at length_.
+  int     utfOffset(int n);
+
+  // ExtendUtfIndex
+  // Step through the characters until character n is reached, noting
+  // where every kUtfSample-th one begins
+  void    ExtendUtfIndex(int n);
+
   // ltNum
   // less than for numbers
   // used by lt
@@ -140,8 +209,19 @@ class Text {
   // used by lt
   bool ltStr(Text* t);
   
+  static const int kUtfSample = 64;
+  static const int kShortNumber = 9;   // digits that cannot overflow
+
   uint32  my_hash_;
+  number  number_;       // the value of getNumber, if number_known_
+  bool    number_known_;
   int     max_length_;
+  bool    borrowed_;     // string_ belongs to someone else
+  int     ascii_;        // 1 if all ASCII, 0 if not, -1 if not yet known
+  int     utf_length_;   // the number of characters, or -1
+  int*    utf_index_;    // byte index of character k * kUtfSample
+  int     utf_indexed_;  // the characters stepped through by the index
+  int     utf_scanned_;  // the byte index that they end at
 };
 
 #endif  // SRC_TEXT_H_
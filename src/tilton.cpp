@@ -9,14 +9,17 @@
 #include <map>
 
 #include "context.h"
+#include "file_writer.h"
 #include "node.h"
 #include "function.h"
 #include "option.h"
+#include "output_buffer.h"
 
 MacroProcessor::MacroProcessor() {
   top_frame_  = new Context(NULL, NULL);
   in_         = new Text();
   the_output_ = new Text(1024);
+  OutputBuffer::instance()->Attach(the_output_);
 }
 
 MacroProcessor::~MacroProcessor() {
@@ -32,9 +35,11 @@ MacroProcessor::~MacroProcessor() {
 
 void MacroProcessor::CreateOptionProcessors() {
   option_processors_.insert(std::make_pair('e', new EvalProcessor()));
+  option_processors_.insert(std::make_pair('f', new FlushProcessor()));
   option_processors_.insert(std::make_pair('g', new GoProcessor()));
   option_processors_.insert(std::make_pair('h', new HelpProcessor()));
   option_processors_.insert(std::make_pair('i', new IncludeProcessor()));
+  option_processors_.insert(std::make_pair('l', new LimitProcessor()));
   option_processors_.insert(std::make_pair('m', new MuteProcessor()));
   option_processors_.insert(std::make_pair('n', new NoProcessor()));
   option_processors_.insert(std::make_pair('r', new ReadProcessor()));
@@ -93,8 +98,12 @@ void MacroProcessor::Run(bool go) {
     top_frame_->ParseAndEvaluate(in_, the_output_);
   }
 
-  // and finally
-  the_output_->WriteStdOutput();
+  // and finally, once the files are written
+  if (!FileWriter::instance()->Flush()) {
+    top_frame_->ReportErrorAndDie("Error in writing file",
+                                  FileWriter::instance()->failed());
+  }
+  OutputBuffer::instance()->Write(stdout);
 }
 
 // Singleton implementation for macro list
@@ -15,6 +15,7 @@ const int kArgZero  = 0;
 const int kArgOne   = 1;
 const int kArgTwo   = 2;
 const int kArgThree = 3;
+const int kArgFour  = 4;
 
 
 // Builtin is the signature for built-in functions
@@ -40,6 +41,7 @@ const number kNAN = 0x80000000;
 // Unsigned ints are used in computing hash.
 
 typedef unsigned long int  uint32;   /* unsigned 4-byte quantities */
+typedef unsigned long long uint64;   /* unsigned 8-byte quantities */
 typedef unsigned      char uint8;    /* unsigned 1-byte quantities */
 
 // MacroProcessor -- coordinator for macro processing
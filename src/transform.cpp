@@ -0,0 +1,275 @@
+// Copyright (c) 2011 Revelux Labs, LLC. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+#include "transform.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    defined(__SSE2__)
+#define TILTON_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+#include "text.h"
+
+#ifdef TILTON_X86_SIMD
+
+// Returns the index of the first byte whose low and high halves select
+// entries with a bit in common, or the index where the whole blocks end.
+__attribute__((target("ssse3")))
+static int FindWorkSSSE3(const char* s, int len, const unsigned char* low,
+                         const unsigned char* high) {
+  const __m128i low_table =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(low));
+  const __m128i high_table =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(high));
+  const __m128i nibble = _mm_set1_epi8(0x0F);
+  const __m128i zero = _mm_setzero_si128();
+  int i = 0;
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+    __m128i lo = _mm_shuffle_epi8(low_table, _mm_and_si128(v, nibble));
+    __m128i hi = _mm_shuffle_epi8(
+        high_table, _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+    __m128i clean = _mm_cmpeq_epi8(_mm_and_si128(lo, hi), zero);
+    int mask = _mm_movemask_epi8(clean) ^ 0xFFFF;
+    if (mask) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  return i;
+}
+
+static bool HaveSSSE3() {
+  static int have = -1;
+  if (have < 0) {
+    __builtin_cpu_init();
+    have = __builtin_cpu_supports("ssse3") ? 1 : 0;
+  }
+  return have == 1;
+}
+
+#endif  // TILTON_X86_SIMD
+
+Transform::Transform() {
+  for (int c = 0; c < 256; c += 1) {
+    action_[c] = kKeep;
+  }
+  separator_ = " ";
+  separator_length_ = 1;
+  Prepare();
+}
+
+Transform::~Transform() {
+}
+
+void Transform::Replace(int c, const char* replacement) {
+  int len = static_cast<int>(strlen(replacement));
+  if (len > kMaxReplacement) {
+    len = kMaxReplacement;
+  }
+  unsigned char b = static_cast<unsigned char>(c);
+  memcpy(replacement_[b], replacement, len);
+  action_[b] = static_cast<signed char>(len);
+  Prepare();
+}
+
+void Transform::Squeeze(int c) {
+  action_[static_cast<unsigned char>(c)] = kSqueeze;
+  Prepare();
+}
+
+void Transform::set_separator(const char* separator) {
+  separator_ = separator;
+  separator_length_ = static_cast<int>(strlen(separator));
+  Prepare();
+}
+
+// Each high half has a row of the low halves that need work with it. Rows
+// that are alike share one of 8 bits: high_ holds the bit of the row, and
+// low_ the bits of every row that holds the low half. More than 8 distinct
+// rows cannot be told apart, and the scan falls back to the table.
+void Transform::Prepare() {
+  growth_ = 0;
+  for (int c = 0; c < 256; c += 1) {
+    int grows = action_[c] == kKeep ? 0 : action_[c] == kSqueeze
+                ? separator_length_ - 1 : action_[c] - 1;
+    if (grows > growth_) {
+      growth_ = grows;
+    }
+  }
+
+  unsigned int rows[8];
+  int row_count = 0;
+  memset(low_, 0, sizeof(low_));
+  memset(high_, 0, sizeof(high_));
+  nibbles_ = true;
+  for (int h = 0; h < 16; h += 1) {
+    unsigned int row = 0;
+    for (int l = 0; l < 16; l += 1) {
+      if (action_[h * 16 + l] != kKeep) {
+        row |= 1u << l;
+      }
+    }
+    if (row == 0) {
+      continue;
+    }
+    int k = 0;
+    while (k < row_count && rows[k] != row) {
+      k += 1;
+    }
+    if (k == row_count) {
+      if (row_count == 8) {
+        nibbles_ = false;
+        return;
+      }
+      rows[row_count] = row;
+      row_count += 1;
+    }
+    high_[h] = static_cast<unsigned char>(1 << k);
+    for (int l = 0; l < 16; l += 1) {
+      if (row & (1u << l)) {
+        low_[l] |= static_cast<unsigned char>(1 << k);
+      }
+    }
+  }
+}
+
+int Transform::FindWork(const char* s, int len) const {
+  int i = 0;
+#ifdef TILTON_X86_SIMD
+  if (nibbles_ && HaveSSSE3()) {
+    i = FindWorkSSSE3(s, len, low_, high_);
+  }
+#endif
+  for (; i < len; i += 1) {
+    if (action_[static_cast<unsigned char>(s[i])] != kKeep) {
+      return i;
+    }
+  }
+  return len;
+}
+
+void Transform::Apply(const char* s, int len, Text* out) const {
+  if (len <= 0) {
+    return;
+  }
+
+  // measure the output so that it is allocated once
+  int size = len;
+  if (growth_ > 0) {
+    for (int i = FindWork(s, len); i < len;
+         i += 1 + FindWork(s + i + 1, len - i - 1)) {
+      int action = action_[static_cast<unsigned char>(s[i])];
+      size += (action == kSqueeze ? separator_length_ : action) - 1;
+    }
+  }
+  out->Reserve(size);
+
+  bool squeezed = false;  // squeezed bytes have been skipped
+  bool started = false;   // something has been written
+  int i = 0;
+  while (i < len) {
+    int j = i + FindWork(s + i, len - i);
+    int action = j < len ? action_[static_cast<unsigned char>(s[j])] : kKeep;
+    if (j > i || action > 0) {
+      if (squeezed && started) {
+        out->AddToString(separator_, separator_length_);
+      }
+      squeezed = false;
+      started = true;
+      out->AddToString(s + i, j - i);
+    }
+    if (action == kSqueeze) {
+      squeezed = true;
+    } else if (action > 0) {
+      out->AddToString(replacement_[static_cast<unsigned char>(s[j])],
+                       action);
+    }
+    i = j + 1;
+  }
+}
+
+const Transform& Transform::Entityify() {
+  static Transform* transform = NULL;
+  if (transform == NULL) {
+    transform = new Transform();
+    transform->Replace('&', "&amp;");
+    transform->Replace('<', "&lt;");
+    transform->Replace('>', "&gt;");
+    transform->Replace('"', "&quot;");
+    transform->Replace('\'', "&#039;");
+    transform->Replace('\\', "&#092;");
+    transform->Replace('~', "&#126;");
+  }
+  return *transform;
+}
+
+const Transform& Transform::JsonEscape() {
+  static Transform* transform = NULL;
+  if (transform == NULL) {
+    transform = new Transform();
+    char escape[kMaxReplacement + 1];
+    for (int c = 0; c < ' '; c += 1) {
+      snprintf(escape, sizeof(escape), "\\u%04x", c);
+      transform->Replace(c, escape);
+    }
+    transform->Replace('\b', "\\b");
+    transform->Replace('\f', "\\f");
+    transform->Replace('\n', "\\n");
+    transform->Replace('\r', "\\r");
+    transform->Replace('\t', "\\t");
+    transform->Replace('"', "\\\"");
+    transform->Replace('\\', "\\\\");
+  }
+  return *transform;
+}
+
+const Transform& Transform::Slashify() {
+  static Transform* transform = NULL;
+  if (transform == NULL) {
+    transform = new Transform();
+    transform->Replace('\\', "\\\\");
+    transform->Replace('\'', "\\'");
+    transform->Replace('"', "\\\"");
+  }
+  return *transform;
+}
+
+// Control characters, the space, and every byte from 0x80 are squeezed,
+// because trim has always compared them as signed characters.
+const Transform& Transform::Trim() {
+  static Transform* transform = NULL;
+  if (transform == NULL) {
+    transform = new Transform();
+    for (int c = 0; c <= ' '; c += 1) {
+      transform->Squeeze(c);
+    }
+    for (int c = 0x80; c < 256; c += 1) {
+      transform->Squeeze(c);
+    }
+  }
+  return *transform;
+}
+
+// Everything but the unreserved characters of RFC 3986 is percent-encoded.
+const Transform& Transform::UrlEncode() {
+  static Transform* transform = NULL;
+  if (transform == NULL) {
+    transform = new Transform();
+    char escape[kMaxReplacement + 1];
+    for (int c = 0; c < 256; c += 1) {
+      if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+          (c >= '0' && c <= '9') || c == '-' || c == '.' || c == '_' ||
+          c == '~') {
+        continue;
+      }
+      snprintf(escape, sizeof(escape), "%%%02X", c);
+      transform->Replace(c, escape);
+    }
+  }
+  return *transform;
+}
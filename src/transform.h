@@ -0,0 +1,72 @@
+// Copyright (c) 2011 Revelux Labs, LLC. All rights reserved.
+// Use of this source code is governed by a MIT-style license that can be
+// found in the LICENSE file.
+
+#ifndef SRC_TRANSFORM_H_
+#define SRC_TRANSFORM_H_
+
+class Text;
+
+// Transform -- rewrites text according to a table of bytes.
+//  Every byte is either kept, replaced by a string, or squeezed: a run of
+//  squeezed bytes becomes a single separator between kept text, and
+//  disappears at either end. Apply finds the bytes that need work many at
+//  a time and copies the runs between them to the output in one step.
+
+//  The bytes that need work are found with a pair of 16-entry tables, one
+//  indexed by the low half of a byte and one by the high half, whose
+//  entries have a bit in common only for those bytes. With SSSE3 both
+//  lookups are done on 16 bytes at once.
+
+class Transform {
+ public:
+  Transform();
+  virtual ~Transform();
+
+  // Replace
+  // Write the byte c as the replacement, which is at most 8 bytes
+  void    Replace(int c, const char* replacement);
+
+  // Squeeze
+  // Treat the byte c as a separator
+  void    Squeeze(int c);
+
+  // set_separator
+  // The string written for a run of squeezed bytes
+  void    set_separator(const char* separator);
+
+  // Apply
+  // Append the transformed text to the output
+  void    Apply(const char* s, int len, Text* out) const;
+
+  // The transforms of the builtins
+  static const Transform& Entityify();
+  static const Transform& JsonEscape();
+  static const Transform& Slashify();
+  static const Transform& Trim();
+  static const Transform& UrlEncode();
+
+ private:
+  // Prepare
+  // Rebuild the lookup tables after a change to the table
+  void    Prepare();
+
+  // FindWork
+  // Returns the index of the first byte that is not kept, or len
+  int     FindWork(const char* s, int len) const;
+
+  static const int kKeep = -1;
+  static const int kSqueeze = -2;
+  static const int kMaxReplacement = 8;
+
+  signed char   action_[256];     // replacement length, kKeep or kSqueeze
+  char          replacement_[256][kMaxReplacement];
+  const char*   separator_;
+  int           separator_length_;
+  int           growth_;          // most bytes one input byte can add
+  bool          nibbles_;         // the nibble tables are exact
+  unsigned char low_[16];
+  unsigned char high_[16];
+};
+
+#endif  // SRC_TRANSFORM_H_
@@ -27,12 +27,37 @@ describe "A command line macro processor (in general)" do
     result.should.include "%title Revelux"
   end
 
+  it "should process the flush option from the command line" do
+    # setup fixture
+    # execute SUT
+    result = %x[ echo "<~define~f~(<~1~>)~>a<~f~b~>c" | ./tilton -r "test/front.snip" -f ]
+    # verify results
+    result.size.should.be 1938 + 6
+    result.should.include "a(b)c"
+  end
+
+  it "should write the output before an error with the flush option" do
+    # setup fixture
+    # execute SUT
+    result = %x[ (echo "before"; sleep 1; echo "<~nosuch~>") | ./tilton -f 2> /dev/null ]
+    # verify results
+    result.should.include "before\n[standard input](2,3/10) <~nosuch~> Undefined macro."
+  end
+
   it "should process the help option from the command line" do
     # setup fixture
     # execute SUT
     result = %x[ ./tilton -h ]
     # verify results
-    result.size.should.be 243
+    result.size.should.be 273
+  end
+
+  it "should process the limit option from the command line" do
+    # setup fixture
+    # execute SUT
+    result = %x[ echo "<~define~r~<~eq?~<~1~>~0~done~<~r~<~sub~<~1~>~1~>~>~>~><~r~100~>" | ./tilton -limit 20 2> /dev/null ]
+    # verify results
+    result.should.include "<~r~> (1,3/3) <~sub~> Too deep."
   end
 
   it "should process the mute option from the command line" do
@@ -43,6 +68,14 @@ describe "A command line macro processor (in general)" do
     result.size.should.be 0
   end
 
+  it "should mute a large output from the command line" do
+    # setup fixture
+    # execute SUT
+    result = %x[ ./tilton -e "<~for~1~100000~1~abc~>" -m -e "tail" -n ]
+    # verify results
+    result.should.equal "tail"
+  end
+
   it "should process the read option from the command line" do
     # setup fixture
     # execute SUT
@@ -51,6 +84,18 @@ describe "A command line macro processor (in general)" do
     result.size.should.be 1938
   end
 
+  it "should read a large file onto itself from the command line" do
+    # setup fixture
+    %x[ ./tilton -e "<~for~1~20000~1~abcdefgh~>" -w big.txt -n ]
+    # execute SUT
+    %x[ ./tilton -r big.txt -e "x" -w big.txt -n ]
+    result = %x[ ./tilton -r big.txt -n | wc -c ]
+    # verify results
+    result.should.include "160001"
+    # tear down fixture
+    %x[ rm big.txt ]
+  end
+
   it "should process the set option from the command line" do
     # setup fixture
     name = "Carl_Hollywood"
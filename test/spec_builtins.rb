@@ -21,6 +21,14 @@ describe "A command line macro processor (in general)" do
     result.should.include "<~add~> Not a number: Tilton"
   end
 
+  it "should process the add builtin with many args" do
+    # setup fixture
+    # execute SUT
+    result = %x[ echo "<~define~x~<~11~>,<~12~z~><~12~>~><~x~1~2~3~4~5~6~7~8~9~10~11~>,<~add~1~2~3~4~5~6~7~8~9~10~11~12~>" | ./tilton ]
+    # verify results
+    result.should.include "11,z,78"
+  end
+
   it "should process the add builtin with a macro arg" do
     # setup fixture
     # execute SUT
@@ -75,6 +83,14 @@ describe "A command line macro processor (in general)" do
     result.should.include "123"
   end
 
+  it "should process the count builtin" do
+    # setup fixture
+    # execute SUT
+    result = %x[ echo "[<~count~a,b;;c~,~;~>][<~count~aaaa~aa~>][<~count~abc~x~>]" | ./tilton ]
+    # verify results
+    result.should.include "[3][2][0]"
+  end
+
   it "should process the define builtin" do
     # setup fixture
     # execute SUT
@@ -129,6 +145,14 @@ describe "A command line macro processor (in general)" do
     result.should.equal "\n"
   end
 
+  it "should forget a deleted macro" do
+    # setup fixture
+    # execute SUT
+    result = %x[ echo "<~define~x~1~><~defined?~x~y~n~><~delete~x~><~defined?~x~y~n~>" | ./tilton ]
+    # verify results
+    result.should.include "yn"
+  end
+
   it "should process the delete builtin when the variable does not exist" do
     # setup fixture
     # execute SUT
@@ -203,6 +227,23 @@ describe "A command line macro processor (in general)" do
     result.size.should.be 1939
   end
 
+  it "should process the read builtin with an offset and a length" do
+    # setup fixture
+    # execute SUT
+    result = %x[ echo "[<~read~test/front.snip~0~4~>][<~length~<~read~test/front.snip~1934~>~>][<~read~test/front.snip~5000~>]" | ./tilton ]
+    # verify results
+    result.should.include "[#{File.read('test/front.snip')[0, 4]}][4][]"
+  end
+
+  it "should process the read builtin with an empty offset or length" do
+    # setup fixture
+    # execute SUT
+    result = %x[ echo "[<~length~<~read~test/front.snip~~>~>][<~length~<~read~test/front.snip~~~>~>][<~read~test/front.snip~~4~>][<~read~test/front.snip~1934~~>]" | ./tilton ]
+    # verify results
+    snip = File.read('test/front.snip')
+    result.should.include "[1938][1938][#{snip[0, 4]}][#{snip[1934, 4]}]"
+  end
+
   it "should process the include builtin" do
     # setup fixture
     # execute SUT
@@ -211,7 +252,16 @@ describe "A command line macro processor (in general)" do
     result.should.include "%title Revelux"
   end
 
-it "should process the include builtin with null args" do
+it "should process the include builtin many times over" do
+    # setup fixture
+    # execute SUT
+    result = %x[ echo "<~include~test/head.snip~One~><~include~test/head.snip~Two~><~include~test/head.snip~One~>" | ./tilton ]
+    # verify results
+    result.scan("%title One").size.should.be 2
+    result.should.include "%title Two"
+  end
+
+  it "should process the include builtin with null args" do
     # setup fixture
     # execute SUT
     result = %x[ echo "<~include~test/head.snip~~front~~~>" | ./tilton ]
@@ -230,6 +280,25 @@ it "should process the include builtin with null args" do
     %x[ rm dump.txt ]
   end
 
+  it "should process the dump builtin with statistics" do
+    # setup fixture
+    # execute SUT
+    result = %x[ echo "<~set~a~1~><~dump~stats~>" | ./tilton 2>&1 ]
+    # verify results
+    result.should.include "a~1"
+    result.should.include "longest probe"
+  end
+
+  it "should not keep the symbols of deleted macros" do
+    # setup fixture
+    churn = "<~set~n~<~gensym~>~><~set~g<~n~>~x~><~delete~g<~n~>~>"
+    # execute SUT
+    once = %x[ echo "#{churn}<~dump~stats~>" | ./tilton 2>&1 ]
+    result = %x[ echo "<~for~1~20000~1~#{churn}~><~dump~stats~>" | ./tilton 2>&1 ]
+    # verify results
+    result[/symbols \d+, slots \d+/].should.equal once[/symbols \d+, slots \d+/]
+  end
+
   it "should process the entityify builtin" do
     # setup fixture
     # execute SUT
@@ -246,6 +315,30 @@ it "should process the include builtin with null args" do
     result.should.include "my token"
   end
 
+  it "should process the eval builtin without an argument" do
+    # setup fixture
+    # execute SUT
+    result = %x[ printf 'a<~eval~>b' | ./tilton ]
+    # verify results
+    result.should.equal "ab"
+  end
+
+  it "should process the field builtin" do
+    # setup fixture
+    # execute SUT
+    result = %x[ echo "<~set~r~a,b;c,d~>[<~field~<~r~>~3~,~;~>][<~field~<~r~>~-1~,~>][<~field~<~r~>~9~,~>][<~r~>]" | ./tilton ]
+    # verify results
+    result.should.include "[c][d][][a,b;c,d]"
+  end
+
+  it "should produce an error msg on the field builtin without a number" do
+    # setup fixture
+    # execute SUT
+    result = %x[ echo "<~field~abc~>" | ./tilton 2> /dev/null ]
+    # verify results
+    result.should.include "<~field~> Too few parameters."
+  end
+
   it "should process the first builtin" do
     # setup fixture
     # execute SUT
@@ -254,6 +347,80 @@ it "should process the include builtin with null args" do
     result.should.include "hi"
   end
 
+  it "should process the first and last builtins with several delimiters" do
+    # setup fixture
+    # execute SUT
+    result = %x[ echo "<~set~t~a;b,,c:d~><~first~t~,~;~>[<~0~>]<~first~t~:~,,~,~>[<~0~>]<~last~t~;~:~>[<~0~>]<~get~t~>" | ./tilton ]
+    # verify results
+    result.should.include "a[;]b[,,]d[:]c"
+  end
+
+  it "should take every token of a long list with the first builtin" do
+    # setup fixture
+    list = (1..2000).map { |i| "i#{i}" }.join(",")
+    # execute SUT
+    result = %x[ echo "<~set~v~#{list},~><~define~w~<~first~v~,~>.<~eq?~<~0~>~~~<~w~>~>~><~w~>[<~get~v~>]" | ./tilton ]
+    # verify results
+    result.should.include "i1.i2.i3."
+    result.should.include "i1999.i2000..[]"
+  end
+
+  it "should process the for builtin" do
+    # setup fixture
+    # execute SUT
+    result = %x[ echo "[<~for~1~5~1~<~1~>,~>][<~for~10~1~-3~<~mult~<~1~>~<~1~>~>;~>]" | ./tilton ]
+    # verify results
+    result.should.include "[1,2,3,4,5,][100;49;16;1;]"
+  end
+
+  it "should produce an error msg on the for builtin with a zero step" do
+    # setup fixture
+    # execute SUT
+    result = %x[ echo "<~for~1~5~0~x~>" | ./tilton 2> /dev/null ]
+    # verify results
+    result.should.include "<~for~> Bad step: 0"
+  end
+
+  it "should produce an error msg on the for builtin without a step" do
+    # setup fixture
+    # execute SUT
+    result = %x[ echo "<~for~1~2~>" | ./tilton 2> /dev/null ]
+    # verify results
+    result.should.include "<~for~> Too few parameters."
+  end
+
+  it "should produce an error msg on the for builtin without arguments" do
+    # setup fixture
+    # execute SUT
+    result = %x[ echo "<~for~>" | ./tilton 2> /dev/null ]
+    # verify results
+    result.should.include "<~for~> Too few parameters."
+  end
+
+  it "should process the for builtin without a body" do
+    # setup fixture
+    # execute SUT
+    result = %x[ echo "[<~for~1~3~1~>]" | ./tilton ]
+    # verify results
+    result.should.include "[]"
+  end
+
+  it "should process the foreach builtin" do
+    # setup fixture
+    # execute SUT
+    result = %x[ echo "<~foreach~a,b;;c,~(<~1~>)~,~;~>" | ./tilton ]
+    # verify results
+    result.should.include "(a)(b)()(c)"
+  end
+
+  it "should process the foreach builtin over a long list within a macro" do
+    # setup fixture
+    # execute SUT
+    result = %x[ echo "<~define~sum~<~set~s~0~><~foreach~<~1~>~<~set~s~<~add~<~s~>~<~1~>~>~>~,~><~s~>~><~sum~<~rep~1,~5000~>~>" | ./tilton ]
+    # verify results
+    result.should.include "5000"
+  end
+
   it "should process the gensym builtin" do
     # setup fixture
     # execute SUT
@@ -270,6 +437,22 @@ it "should process the include builtin with null args" do
     result.should.include "hi!"
   end
 
+  it "should process the index builtin" do
+    # setup fixture
+    # execute SUT
+    result = %x[ echo "[<~index~hello world~o~>][<~index~abc~c~b~>][<~index~abc~z~>]" | ./tilton ]
+    # verify results
+    result.should.include "[5][2][]"
+  end
+
+  it "should process the jsonify builtin" do
+    # setup fixture
+    # execute SUT
+    result = %x[ echo '<~jsonify~say "hi" \\ <~unicode~9~>~>' | ./tilton ]
+    # verify results
+    result.should.include 'say \"hi\" \\\\ \t'
+  end
+
   it "should process the last builtin" do
     # setup fixture
     # execute SUT
@@ -310,6 +493,15 @@ it "should process the include builtin with null args" do
     result.should.include "3"
   end
 
+  it "should process the length and substr builtins on long mixed UTF-8 text" do
+    # setup fixture
+    text = "aé€" * 100
+    # execute SUT
+    result = %x[ echo "<~define~t~<~length~<~1~>~>,<~eq?~<~substr~<~1~>~200~4~>~é€aé~yes~no~>,<~eq?~<~substr~<~1~>~2~2~>~é€~yes~no~>~><~t~#{text}~>" | ./tilton ]
+    # verify results
+    result.should.include "300,yes,yes"
+  end
+
   it "should process the literal builtin" do
     # setup fixture
     # execute SUT
@@ -318,6 +510,14 @@ it "should process the include builtin with null args" do
     result.should.include "42"
   end
 
+  it "should evaluate plain and bracketed arguments alike" do
+    # setup fixture
+    # execute SUT
+    result = %x[ echo "<~define~x~<~1~>-<~2~>-<~1~>~><~x~plain < text~<~add~1~2~>~>" | ./tilton ]
+    # verify results
+    result.should.include "plain < text-3-plain < text"
+  end
+
   it "should process the loop builtin" do
     # setup fixture
     # execute SUT
@@ -337,6 +537,45 @@ it "should process the include builtin with null args" do
     result.should.include "<"
   end
 
+  it "should process the match builtin" do
+    # setup fixture
+    # execute SUT
+    result = %x[ printf '%s\\n' '[<~match~order 66 shipped~[0-9]+~>][<~match~Ada Lovelace~(\\w+) (\\w+)~2~>][<~match~abc~x~>]' | ./tilton ]
+    # verify results
+    result.should.include "[66][Lovelace][]"
+  end
+
+  it "should process the match builtin without backtracking" do
+    # setup fixture
+    # execute SUT
+    result = %x[ printf '%s\\n' '[<~match~aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaac~(a|aa)*(a*)*b~>]' | ./tilton ]
+    # verify results
+    result.should.include "[]"
+  end
+
+  it "should process the match builtin with a long pattern" do
+    # setup fixture
+    File.open("regex.txt", "w") { |f| f.write("[<~match~aaa~#{'a' * 99000}~>][<~match~xyz~#{'a' * 99000}|y~>]") }
+    # execute SUT
+    result = %x[ ./tilton < regex.txt ]
+    # verify results
+    result.should.include "[][y]"
+    # tear down fixture
+    %x[ rm regex.txt ]
+  end
+
+  it "should produce an error msg on the match builtin with a pattern too large" do
+    # setup fixture
+    File.open("regex.txt", "w") { |f| f.write("<~match~x~#{'x?' * 100000}~>") }
+    File.open("nested.txt", "w") { |f| f.write("<~match~a~#{'(' * 20000}a#{')' * 20000}~>") }
+    # execute SUT
+    result = %x[ ./tilton < regex.txt 2> /dev/null ] + %x[ ./tilton < nested.txt 2> /dev/null ]
+    # verify results
+    result.scan("<~match~> Pattern too large").size.should.be 2
+    # tear down fixture
+    %x[ rm regex.txt nested.txt ]
+  end
+
   it "should process the mod builtin" do
     # setup fixture
     # execute SUT
@@ -353,6 +592,14 @@ it "should process the include builtin with null args" do
     result.should.include "6"
   end
 
+  it "should format every digit of a large product" do
+    # setup fixture
+    # execute SUT
+    result = %x[ echo "[<~mult~-2147483648~-100~>][<~mult~10~-2147483648~>]" | ./tilton ]
+    # verify results
+    result.should.include "[214748364800][-21474836480]"
+  end
+
   it "should process the mute builtin" do
     # setup fixture
     # execute SUT
@@ -396,6 +643,14 @@ it "should process the include builtin with null args" do
     %x[ rm print.txt ]
   end
 
+  it "should process the regex-replace builtin" do
+    # setup fixture
+    # execute SUT
+    result = %x[ printf '%s\\n' '<~regex-replace~Ada Lovelace, Alan Turing~(\\w+) (\\w+)~\\2 \\1~>' | ./tilton ]
+    # verify results
+    result.should.include "Lovelace Ada, Turing Alan"
+  end
+
   it "should process the rep builtin" do
     # setup fixture
     # execute SUT
@@ -404,6 +659,30 @@ it "should process the include builtin with null args" do
     result.should.include "666666"
   end
 
+  it "should process the replace builtin" do
+    # setup fixture
+    # execute SUT
+    result = %x[ echo "<~replace~the cat sat on the mat~at~og~the~a~>" | ./tilton ]
+    # verify results
+    result.should.include "a cog sog on a mog"
+  end
+
+  it "should process the replace builtin without rescanning replaced text" do
+    # setup fixture
+    # execute SUT
+    result = %x[ echo "[<~replace~aaaab~aa~a~ab~x~>]" | ./tilton ]
+    # verify results
+    result.should.include "[aab]"
+  end
+
+  it "should produce an error msg on the replace builtin without a text" do
+    # setup fixture
+    # execute SUT
+    result = %x[ echo "<~replace~>" | ./tilton 2> /dev/null ]
+    # verify results
+    result.should.include "<~replace~> Too few parameters."
+  end
+
   it "should process the slashify builtin" do
     # setup fixture
     # execute SUT
@@ -412,6 +691,35 @@ it "should process the include builtin with null args" do
     result.should.include "\\'Hello\\'"
   end
 
+  it "should process the sort builtin" do
+    # setup fixture
+    # execute SUT
+    result = %x[ echo "[<~sort~pear,10,apple,9,fig,~,~>][<~sort~b;a;b;2;10~;~reverse~unique~>]" | ./tilton ]
+    # verify results
+    result.should.include "[9,10,apple,fig,pear,][b;a;10;2]"
+  end
+
+  it "should process the sort builtin on a long list" do
+    # setup fixture
+    # execute SUT
+    result = %x[ echo "<~set~l~<~for~40000~1~-1~<~1~>,~>~><~set~a~<~sort~<~l~>~,~>~><~set~d~<~sort~<~a~>~,~reverse~>~><~first~a~,~>,<~first~d~,~>,<~length~<~a~>~>" | ./tilton ]
+    result.should.include "1,40000,228892"
+  end
+
+  it "should sort a long list of numbers and strings in one order" do
+    # setup fixture
+    items = (1..20000).map { |i| i % 3 == 0 ? "#{i % 97}a" : (i % 5 == 0 ? "-#{i}" : "#{i}") }
+    File.open("mixed.txt", "w") { |f| f.write(items.join(",") + ",") }
+    group = lambda { |s| s =~ /\A[0-9]+\z/ ? 1 : (s < "0" ? 0 : 2) }
+    sorted = items.each_with_index.sort_by { |s, i| [group.call(s), group.call(s) == 1 ? s.to_i : 0, group.call(s) == 1 ? "" : s, i] }.map { |s, i| s }
+    # execute SUT
+    result = %x[ echo "[<~sort~<~read~mixed.txt~>~,~>][<~sort~2,10,1a,b~,~>]" | ./tilton ]
+    # verify results
+    result.should.include "[#{sorted.join(",")},][2,10,1a,b]"
+    # tear down fixture
+    %x[ rm mixed.txt ]
+  end
+
   it "should process the stop builtin" do
     # setup fixture
     # execute SUT
@@ -484,6 +792,14 @@ it "should process the include builtin with null args" do
     result.should.include "Hello World !"
   end
 
+  it "should process the trim builtin with an empty argument" do
+    # setup fixture
+    # execute SUT
+    result = %x[ echo "[<~trim~~>]" | ./tilton ]
+    # verify results
+    result.should.include "[]"
+  end
+
   it "should process the unicode builtin" do
     # setup fixture
     # execute SUT
@@ -492,6 +808,38 @@ it "should process the include builtin with null args" do
     result.should.include "Cat"
   end
 
+  it "should process the urlencode builtin" do
+    # setup fixture
+    # execute SUT
+    result = %x[ printf '<~urlencode~a-b c&d=e/\\303\\251~>\\n' | ./tilton ]
+    # verify results
+    result.should.include "a-b%20c%26d%3De%2F%C3%A9"
+  end
+
+  it "should recurse through a conditional without growing the stack" do
+    # setup fixture
+    # execute SUT
+    result = %x[ echo "<~define~r~<~eq?~<~1~>~0~done~<~r~<~sub~<~1~>~1~>~>~>~><~r~50000~>" | ./tilton ]
+    # verify results
+    result.should.include "done"
+  end
+
+  it "should stop a runaway tail recursion" do
+    # setup fixture
+    # execute SUT
+    result = %x[ echo "<~define~f~<~f~~>~><~f~>" | ./tilton 2> /dev/null ]
+    # verify results
+    result.should.include "Too deep."
+  end
+
+  it "should stop a recursion whose arguments grow" do
+    # setup fixture
+    # execute SUT
+    result = %x[ echo "<~define~f~<~1~><~f~<~1~>x~>~><~f~a~>" | ./tilton 2> /dev/null ]
+    # verify results
+    result.should.include "Too deep."
+  end
+
   it "should process the write builtin" do
     # setup fixture
     # execute SUT
@@ -502,4 +850,64 @@ it "should process the include builtin with null args" do
     # tear down fixture
     %x[ rm write.txt ]
   end
+
+  it "should report a failed write builtin at the end of the run" do
+    # setup fixture
+    # execute SUT
+    result = %x[ echo "<~write~no/such/dir/write.txt~Hello~>done" | ./tilton ]
+    # verify results
+    result.should.include "Error in writing file: no/such/dir/write.txt"
+    result.should.not.include "done"
+  end
+
+  it "should read a file again after the write builtin changes it" do
+    # setup fixture
+    # execute SUT
+    result = %x[ echo "<~write~write.txt~one~>[<~read~write.txt~>]<~write~write.txt~two~>[<~read~write.txt~>]" | ./tilton ]
+    # verify results
+    result.should.include "[one][two]"
+    # tear down fixture
+    %x[ rm write.txt ]
+  end
+
+  it "should process the write builtin with a name as long as a name can be" do
+    # setup fixture
+    name = "f" * 250
+    # execute SUT
+    %x[ echo "<~write~#{name}~hello~>" | ./tilton ]
+    result = File.read(name)
+    # verify results
+    result.should.equal "hello"
+    # tear down fixture
+    %x[ rm #{name} ]
+  end
+
+  it "should write a file with several names through all of them" do
+    # setup fixture
+    %x[ echo "old" > write.txt; ln write.txt link.txt ]
+    # execute SUT
+    %x[ echo "<~write~write.txt~new~>" | ./tilton ]
+    result = File.read("link.txt")
+    # verify results
+    result.should.equal "new"
+    # tear down fixture
+    %x[ rm write.txt link.txt ]
+  end
+
+  it "should include a file with several names that writes over itself" do
+    # setup fixture
+    # the read, under the other name, waits for the write, which empties
+    # the file in place
+    File.open("write.txt", "w") { |f| f.write("<~write~write.txt~x~>[<~read~link.txt~>]" + "y" * 200000 + "end") }
+    %x[ ln write.txt link.txt ]
+    # execute SUT
+    result = %x[ echo "<~include~write.txt~>" | ./tilton ]
+    # verify results
+    result.size.should.be 200007
+    result.should.include "[x]yyy"
+    result.should.include "yend"
+    File.read("link.txt").should.equal "x"
+    # tear down fixture
+    %x[ rm write.txt link.txt ]
+  end
 end
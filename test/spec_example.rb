@@ -81,4 +81,15 @@ describe "Tilton" do
     result.should.include "5"
   end
 
+  it "should let a macro redefine itself while it runs" do
+    # setup fixture
+    define = "<~define~once~<~define~once~again~>first~>"
+    input = "<~once~> <~once~>"
+    text = define + input
+    # execute SUT
+    result = %x[ echo "#{text}" | ./tilton ]
+    # verify results
+    result.should.include "first again"
+  end
+
 end
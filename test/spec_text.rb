@@ -35,6 +35,14 @@ describe "A command line macro processor (in general)" do
     result.should.include "Extra ~>"
   end
 
+  it "should count lines across long runs of plain text" do
+    # setup fixture
+    # execute SUT
+    result = %x[ printf "#{'x' * 100}\n#{'y' * 100}\n  <~nosuch~>" | ./tilton 2> /dev/null ]
+    # verify results
+    result.should.include "[standard input](3,5/207) <~nosuch~> Undefined macro."
+  end
+
   it "should raise an error for unmatched brackets" do
     # setup fixture
     # execute SUT